@@ -2,10 +2,16 @@ import * as https from 'node:https';
 import { IoTDataPlaneClient, PublishCommand } from "@aws-sdk/client-iot-data-plane";
 import { SSMClient, GetParameterCommand } from "@aws-sdk/client-ssm";
 
-// Chunk size, set this small enough to allow the device to process the message
-const chunk_size = 1600;
+// Default chunk size, used when the device does not report the largest
+// payload it can process
+const default_chunk_size = 1600;
+const min_chunk_size = 256;
+const max_chunk_size = 65536;
 const mqtt_topic = "nrfcloud/agps";
 
+// All A-GNSS types known to nRF Cloud
+const all_types = [ 1,2,3,4,5,6,7,8,9,10,11,12,13 ];
+
 // Connect to the IoT service to send MQTT messages
 const client = new IoTDataPlaneClient({
     region: "us-east-1",
@@ -35,12 +41,37 @@ function parse_content_range(input) {
   return range;
 }
 
+/**
+ * Convert a device type mask (bit n-1 = type n) to a list of types
+ */
+function mask_to_types(mask) {
+  return all_types.filter((type) => mask & (1 << (type - 1)));
+}
+
 /**
  * Request the AGNSS data and publish it to MQTT
  */
 export const handler = (event, context, callback) => {
     console.log("AGNSS request " + JSON.stringify(event));
     
+    // Device fields that are not part of the nRF Cloud request
+    const { chunk_size: device_chunk_size, mask, ...body } = event;
+    
+    // Use the largest chunk the device can take so it needs fewer messages
+    let chunk_size = default_chunk_size;
+    if (Number.isInteger(device_chunk_size)) {
+        chunk_size = Math.min(Math.max(device_chunk_size, min_chunk_size), max_chunk_size);
+    }
+    
+    // Only request the types the device needs, if no types are known get all
+    if (!body.types && Number.isInteger(mask) && mask > 0) {
+        body.types = mask_to_types(mask);
+    }
+    if (!body.types || body.types.length === 0) {
+        body.types = all_types;
+    }
+    console.log(`Chunk size ${chunk_size}, types ${JSON.stringify(body.types)}`);
+    
     let range = {
         start: 0,
         end: chunk_size - 1,
@@ -57,12 +88,36 @@ export const handler = (event, context, callback) => {
         }
     }
     
-    // If no event types are requested get all
-    if (!event.types) {
-        event.types = [ 1,2,3,4,5,6,7,8,9,10,11,12,13 ]
-    }
+    let agps_all = []; // every chunk, for the base64 result
     
-    let agps_b64 = ''; // base64 encoding of the entire agps message
+    // Publishes are chained so chunks go out in order while the next one
+    // downloads, and the Lambda only completes once all of them are settled
+    let publishes = Promise.resolve();
+    const sends = [];
+    const publish = (command) => {
+        const sent = publishes.then(() => client.send(command));
+        // Reported by finish(), a failure while the next range downloads
+        // must not count as an unhandled rejection
+        sent.catch(() => {});
+        publishes = sent;
+        sends.push(sent);
+    };
+    
+    let finished = false;
+    const finish = (err, result) => {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        Promise.allSettled(sends).then((outcomes) => {
+            const failed = outcomes.find((o) => o.status === 'rejected');
+            if (err || failed) {
+                callback(err || failed.reason);
+            } else {
+                callback(null, result);
+            }
+        });
+    };
     
     const chunk_handler = (res) => {
         let chunks = [];
@@ -81,8 +136,8 @@ export const handler = (event, context, callback) => {
                 const content_length = Number(res.headers["content-length"])
                 const content_range = parse_content_range(res.headers["content-range"])
                 
-                // Concat the b64 values
-                agps_b64 = agps_b64 + Buffer.from(agps).toString('base64');
+                // Encode at the end, chunks are not multiples of 3 bytes
+                agps_all.push(agps);
                 
                 // Send the MQTT message
                 const input = {
@@ -95,7 +150,7 @@ export const handler = (event, context, callback) => {
                 };
                 const command = new PublishCommand(input);
                 console.log(`Sending MQTT publish ${agps.length} bytes`);
-                client.send(command).then(console.log);
+                publish(command);
                 
                 // Determine how many bytes remain
                 let bytes_remain = 0;
@@ -115,13 +170,13 @@ export const handler = (event, context, callback) => {
                     console.log("Request Headers: " + JSON.stringify(options));
                     
                     const req = https.request(options, chunk_handler);
-                    req.on('error', callback);
-                    req.write(JSON.stringify(event));
+                    req.on('error', (err) => finish(err));
+                    req.write(JSON.stringify(body));
                     req.end();
                 } else {
                     // Upon completion publish the entire b64 encoded APGS
-                    callback(null, {
-                        "agps": agps_b64
+                    finish(null, {
+                        "agps": Buffer.concat(agps_all).toString('base64')
                     });
                 }
             } else {
@@ -129,7 +184,7 @@ export const handler = (event, context, callback) => {
                 console.log('Failed to process nRF cloud response');
                 const err = Buffer.concat(chunks).toString("utf8");
                 console.log(err);
-                callback(null, {
+                finish(null, {
                     "err": err
                 });
             }
@@ -139,7 +194,7 @@ export const handler = (event, context, callback) => {
     // Make the initial request
     console.log("Request Headers: " + JSON.stringify(options));
     const req = https.request(options, chunk_handler);
-    req.on('error', callback);
-    req.write(JSON.stringify(event));
+    req.on('error', (err) => finish(err));
+    req.write(JSON.stringify(body));
     req.end();
 };
\ No newline at end of file
@@ -0,0 +1,136 @@
+import * as https from 'node:https';
+import { IoTDataPlaneClient, PublishCommand } from "@aws-sdk/client-iot-data-plane";
+import { SSMClient, GetParameterCommand } from "@aws-sdk/client-ssm";
+
+// Invoked by an IoT rule so the device name travels with the request:
+//   SELECT *, topic(2) AS device FROM 'location/+/req'
+// The answer goes back on location/<device>/res.
+
+// Connect to the IoT service to send MQTT messages
+const client = new IoTDataPlaneClient({
+    region: "us-east-1",
+});
+
+const ssm_client = new SSMClient({});
+let servicekey = null;
+
+/**
+ * Get the service key to access the nRFCloud, cached across invocations
+ */
+async function get_servicekey() {
+  if (!servicekey) {
+    const ssmcommand = new GetParameterCommand({ Name: "/nrfcloud/servicekey" });
+    const ssmresponse = await ssm_client.send(ssmcommand);
+    servicekey = ssmresponse.Parameter.Value;
+  }
+  return servicekey;
+}
+
+// The device sends raw modem indexes, nRF Cloud wants dBm / dB
+const rsrp_dbm = (idx) => idx - 140;
+const rsrq_db = (idx) => idx * 0.5 - 19.5;
+
+/**
+ * Convert a device request to an nRF Cloud ground-fix request body
+ */
+export function ground_fix_body(req) {
+  const cell = {
+    mcc: req.mcc,
+    mnc: req.mnc,
+    eci: req.eci,
+    tac: req.tac,
+    earfcn: req.earfcn,
+    pci: req.pci,
+    rsrp: rsrp_dbm(req.rsrp),
+    rsrq: rsrq_db(req.rsrq),
+  };
+  if (req.adv !== undefined && req.adv !== 65535) {
+    cell.adv = req.adv;
+  }
+  if (req.nmr && req.nmr.length > 0) {
+    cell.nmr = req.nmr.map((n) => ({
+      earfcn: n.earfcn,
+      pci: n.pci,
+      rsrp: rsrp_dbm(n.rsrp),
+      rsrq: rsrq_db(n.rsrq),
+    }));
+  }
+  return { lte: [ cell ] };
+}
+
+/**
+ * Convert a fix (degrees / metres) to the compact device response
+ */
+export function device_response(id, fix) {
+  if (!fix) {
+    return { id, err: 1 };
+  }
+  return {
+    id,
+    lat: Math.round(fix.lat * 1e6),
+    lon: Math.round(fix.lon * 1e6),
+    acc: Math.round(fix.uncertainty),
+  };
+}
+
+/**
+ * Resolve the cells through nRF Cloud, returns null when it could not
+ */
+async function ground_fix(body) {
+  const key = await get_servicekey();
+  const options = {
+    hostname: "api.nrfcloud.com",
+    path: "/v1/location/ground-fix",
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+      "Authorization": "Bearer " + key,
+    },
+  };
+
+  return new Promise((resolve, reject) => {
+    const req = https.request(options, (res) => {
+      let data = '';
+      res.setEncoding('utf8');
+      res.on('data', (chunk) => { data += chunk; });
+      res.on('end', () => {
+        if (res.statusCode !== 200) {
+          console.log(`Ground fix failed ${res.statusCode}: ${data}`);
+          resolve(null);
+          return;
+        }
+        resolve(JSON.parse(data));
+      });
+    });
+    req.on('error', reject);
+    req.write(JSON.stringify(body));
+    req.end();
+  });
+}
+
+/**
+ * Resolve a cellular location request and publish the answer to the device
+ */
+export const handler = async (event) => {
+  console.log("Cell location request " + JSON.stringify(event));
+
+  let fix = null;
+  try {
+    fix = await ground_fix(ground_fix_body(event));
+  } catch (err) {
+    console.log("Ground fix error " + err);
+  }
+
+  const response = device_response(event.id, fix);
+  const command = new PublishCommand({
+    topic: `location/${event.device}/res`,
+    qos: 0,
+    retain: false,
+    payload: JSON.stringify(response),
+  });
+
+  // Wait for the publish so the device is answered before we return
+  await client.send(command);
+  console.log("Cell location response " + JSON.stringify(response));
+  return response;
+};
@@ -0,0 +1,49 @@
+import { IoTDataPlaneClient, PublishCommand } from "@aws-sdk/client-iot-data-plane";
+import { S3Client, GetObjectCommand } from "@aws-sdk/client-s3";
+
+// Serves delta patch chunks to devices. Invoked by an IoT rule:
+//   SELECT *, topic(2) AS device FROM 'fota/+/get'
+// The rollout patch (built with tools/fota_delta.mjs) is the S3 object
+// FOTA_BUCKET/FOTA_KEY. Start a device on it by publishing
+// {"size":<patch bytes>,"version":"x.y.z"} to fota/<device>/job.
+
+// Connect to the IoT service to send MQTT messages
+const client = new IoTDataPlaneClient({
+    region: "us-east-1",
+});
+
+const s3_client = new S3Client({});
+
+/**
+ * Fetch one chunk of the patch and publish it, prefixed with its offset
+ */
+export const handler = async (event) => {
+    console.log("FOTA chunk request " + JSON.stringify(event));
+
+    const command = new GetObjectCommand({
+        Bucket: process.env.FOTA_BUCKET,
+        Key: process.env.FOTA_KEY,
+        Range: `bytes=${event.offset}-${event.offset + event.size - 1}`,
+    });
+    const response = await s3_client.send(command);
+    const chunk = Buffer.from(await response.Body.transformToByteArray());
+
+    // The device drops chunks whose offset it is not waiting for
+    const header = Buffer.alloc(4);
+    header.writeUInt32LE(event.offset);
+
+    const input = {
+        topic: `fota/${event.device}/data`,
+        qos: 0,
+        retain: false,
+        payload: Buffer.concat([ header, chunk ]),
+        payloadFormatIndicator: "UNSPECIFIED_BYTES",
+        contentType: "application/octet-stream"
+    };
+
+    // Wait for the publish so the chunk is out before we return
+    await client.send(new PublishCommand(input));
+    console.log(`Sent ${chunk.length} bytes at ${event.offset}`);
+
+    return { offset: event.offset, size: chunk.length };
+};
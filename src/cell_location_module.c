@@ -0,0 +1,139 @@
+#include <zephyr/logging/log.h>
+
+#include "cell_location_module.h"
+#include "config_module.h"
+#include "json_common.h"
+
+LOG_MODULE_REGISTER(cell_location_module);
+
+#define RES_ID	BIT(0)
+#define RES_LAT	BIT(1)
+#define RES_LON	BIT(2)
+#define RES_ACC	BIT(3)
+#define RES_ERR	BIT(4)
+
+static cell_location_publish_t publish_fn;
+
+static atomic_t next_id;
+static atomic_t pending_id;	/* 0 when no request is waiting */
+static int64_t pending_deadline;	/* Uptime the library stops waiting */
+
+static void result_set(enum location_ext_result result, struct location_data *location)
+{
+	atomic_set(&pending_id, 0);
+	location_cloud_location_ext_result_set(result, location);
+}
+
+int cell_location_mod_init(cell_location_publish_t publish)
+{
+	publish_fn = publish;
+
+	return 0;
+}
+
+void cell_location_mod_request(const struct location_data_cloud *request)
+{
+	int err;
+	static char buf[768];
+	const struct lte_lc_cells_info *cells = request->cell_data;
+	struct cell_location_req payload = {0};
+	struct app_config app_cfg;
+
+	if (!cells || cells->current_cell.id == LTE_LC_CELL_EUTRAN_ID_INVALID) {
+		LOG_WRN("No serving cell, cannot resolve cellular location");
+		result_set(LOCATION_EXT_RESULT_ERROR, NULL);
+		return;
+	}
+
+	/* Never hand out 0, it marks "nothing pending". */
+	payload.id = atomic_inc(&next_id) + 1;
+	payload.mcc = cells->current_cell.mcc;
+	payload.mnc = cells->current_cell.mnc;
+	payload.tac = cells->current_cell.tac;
+	payload.eci = cells->current_cell.id;
+	payload.earfcn = cells->current_cell.earfcn;
+	payload.pci = cells->current_cell.phys_cell_id;
+	payload.rsrp = cells->current_cell.rsrp;
+	payload.rsrq = cells->current_cell.rsrq;
+	payload.adv = cells->current_cell.timing_advance;
+
+	payload.nmr_len = MIN(cells->ncells_count, CELL_LOCATION_NCELLS_MAX);
+	for (size_t i = 0; i < payload.nmr_len; i++) {
+		payload.nmr[i].earfcn = cells->neighbor_cells[i].earfcn;
+		payload.nmr[i].pci = cells->neighbor_cells[i].phys_cell_id;
+		payload.nmr[i].rsrp = cells->neighbor_cells[i].rsrp;
+		payload.nmr[i].rsrq = cells->neighbor_cells[i].rsrq;
+	}
+
+	err = json_cell_location_req_construct(buf, sizeof(buf), &payload);
+	if (err) {
+		result_set(LOCATION_EXT_RESULT_ERROR, NULL);
+		return;
+	}
+
+	/* Once the cellular timeout runs out the library falls back or
+	 * gives up, a later answer must not be passed on.
+	 */
+	config_mod_get(&app_cfg);
+	pending_deadline = k_uptime_get() + app_cfg.cell_timeout * MSEC_PER_SEC;
+	atomic_set(&pending_id, payload.id);
+
+	/* Without a connection there is nothing to wait for, fail now rather
+	 * than letting the cellular timeout run out.
+	 */
+	err = publish_fn ? publish_fn(buf, strlen(buf)) : -ENOTCONN;
+	if (err) {
+		LOG_WRN("Cell location request %d not sent, error: %d", payload.id, err);
+		result_set(LOCATION_EXT_RESULT_ERROR, NULL);
+		return;
+	}
+
+	LOG_INF("Cell location request %d sent, %d neighbours", payload.id, payload.nmr_len);
+}
+
+void cell_location_mod_cancel(void)
+{
+	atomic_val_t id = atomic_set(&pending_id, 0);
+
+	if (id) {
+		LOG_DBG("Cell location request %ld cancelled", id);
+	}
+}
+
+int cell_location_mod_response(char *buf, size_t len)
+{
+	struct cell_location_res res = {0};
+	struct location_data location = {0};
+	int fields;
+
+	fields = json_cell_location_res_parse(buf, len, &res);
+	if (fields < 0) {
+		return fields;
+	}
+
+	if (!(fields & RES_ID) || res.id == 0 ||
+	    !atomic_cas(&pending_id, res.id, 0)) {
+		LOG_WRN("Dropping cell location response %d, not pending", res.id);
+		return -EALREADY;
+	}
+
+	if (k_uptime_get() > pending_deadline) {
+		LOG_WRN("Dropping cell location response %d, timed out", res.id);
+		return -ETIMEDOUT;
+	}
+
+	if ((fields & RES_ERR && res.err) ||
+	    (fields & (RES_LAT | RES_LON)) != (RES_LAT | RES_LON)) {
+		LOG_WRN("Cell location request %d not resolved", res.id);
+		location_cloud_location_ext_result_set(LOCATION_EXT_RESULT_UNKNOWN, NULL);
+		return 0;
+	}
+
+	location.latitude = res.lat / 1e6;
+	location.longitude = res.lon / 1e6;
+	location.accuracy = res.acc;
+
+	location_cloud_location_ext_result_set(LOCATION_EXT_RESULT_SUCCESS, &location);
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef CELL_LOCATION_MODULE_H__
+#define CELL_LOCATION_MODULE_H__
+
+#include <modem/location.h>
+
+/* Neighbour cells included in a request. */
+#define CELL_LOCATION_NCELLS_MAX 10
+
+/**
+ * Publishes an encoded request, returns 0 once it is handed to MQTT.
+ */
+typedef int (*cell_location_publish_t)(const char *buf, size_t len);
+
+int cell_location_mod_init(cell_location_publish_t publish);
+
+/**
+ * Handle LOCATION_EVT_CLOUD_LOCATION_EXT_REQUEST. The cell data is encoded
+ * and published immediately, as it is only valid during the event.
+ */
+void cell_location_mod_request(const struct location_data_cloud *request);
+
+/**
+ * Stop waiting for the pending request, call when the location request
+ * ends so a late answer is dropped.
+ */
+void cell_location_mod_cancel(void);
+
+/**
+ * Handle a response document {"id":N,"lat":..,"lon":..,"acc":..} with
+ * microdegree coordinates and accuracy in metres, or {"id":N,"err":1}.
+ * Responses for any request but the last one sent are dropped.
+ */
+int cell_location_mod_response(char *buf, size_t len);
+
+#endif
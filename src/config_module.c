@@ -0,0 +1,180 @@
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+#include "config_module.h"
+#include "json_common.h"
+
+LOG_MODULE_REGISTER(config_module);
+
+#define SETTINGS_CFG_KEY "app/cfg"
+
+struct config_range {
+	int32_t min;
+	int32_t max;
+};
+
+/* Defaults match the values the firmware used before remote tuning. The
+ * A-GNSS mask was never sent before, so all types were downloaded.
+ */
+static struct app_config current = {
+	.fix_interval = 30,
+	.gnss_timeout = 100,
+	.cell_timeout = 40,
+	.ping_period = 10,
+	.agnss_mask = 0x1FFF,
+};
+
+static K_MUTEX_DEFINE(config_lock);
+
+/* Indexed in the same order as the APP_CONFIG_* bits. */
+static const struct config_range ranges[] = {
+	{ 10, 86400 },		/* fix_interval, location library minimum is 10 s */
+	{ 10, 600 },		/* gnss_timeout */
+	{ 5, 120 },		/* cell_timeout */
+	{ 5, 1200 },		/* ping_period, AWS IoT keepalive is 1200 s */
+	{ 1, 0x1FFF },		/* agnss_mask, 13 A-GNSS types */
+};
+
+static const char *const names[] = {
+	"fix_interval",
+	"gnss_timeout",
+	"cell_timeout",
+	"ping_period",
+	"agnss_mask",
+};
+
+static int32_t *config_field(struct app_config *cfg, int idx)
+{
+	int32_t *fields[] = {
+		&cfg->fix_interval,
+		&cfg->gnss_timeout,
+		&cfg->cell_timeout,
+		&cfg->ping_period,
+		&cfg->agnss_mask,
+	};
+
+	return fields[idx];
+}
+
+static int config_settings_set(const char *name, size_t len,
+			       settings_read_cb read_cb, void *cb_arg)
+{
+	struct app_config stored;
+	ssize_t rc;
+
+	if (strcmp(name, "cfg") != 0) {
+		return -ENOENT;
+	}
+
+	if (len != sizeof(stored)) {
+		LOG_WRN("Stored config size mismatch, using defaults");
+		return 0;
+	}
+
+	rc = read_cb(cb_arg, &stored, sizeof(stored));
+	if (rc < 0) {
+		return rc;
+	}
+
+	/* Re-validate in case the stored layout predates a range change. */
+	for (int i = 0; i < ARRAY_SIZE(ranges); i++) {
+		int32_t val = *config_field(&stored, i);
+
+		if (val >= ranges[i].min && val <= ranges[i].max) {
+			*config_field(&current, i) = val;
+		}
+	}
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app, "app", NULL, config_settings_set, NULL, NULL);
+
+int config_mod_init(void)
+{
+	int err;
+
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("settings_subsys_init, error: %d", err);
+		return err;
+	}
+
+	err = settings_load_subtree("app");
+	if (err) {
+		LOG_ERR("settings_load_subtree, error: %d", err);
+		return err;
+	}
+
+	LOG_INF("Config: fix %d s, gnss %d s, cell %d s, ping %d s, agnss 0x%x",
+		current.fix_interval, current.gnss_timeout, current.cell_timeout,
+		current.ping_period, current.agnss_mask);
+
+	return 0;
+}
+
+void config_mod_get(struct app_config *cfg)
+{
+	k_mutex_lock(&config_lock, K_FOREVER);
+	*cfg = current;
+	k_mutex_unlock(&config_lock);
+}
+
+static int config_process(char *buf, size_t len,
+			  int (*parse)(char *, size_t, struct app_config *))
+{
+	struct app_config delta;
+	int changed = 0;
+	int ret;
+
+	k_mutex_lock(&config_lock, K_FOREVER);
+
+	/* Fields absent from the delta keep their current value. */
+	delta = current;
+
+	ret = parse(buf, len, &delta);
+	if (ret < 0) {
+		goto out;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(ranges); i++) {
+		int32_t val = *config_field(&delta, i);
+
+		if (val == *config_field(&current, i)) {
+			continue;
+		}
+
+		if (val < ranges[i].min || val > ranges[i].max) {
+			LOG_WRN("Rejecting %s = %d, range [%d, %d]",
+				names[i], val,
+				ranges[i].min, ranges[i].max);
+			continue;
+		}
+
+		*config_field(&current, i) = val;
+		changed |= BIT(i);
+	}
+
+	if (changed) {
+		ret = settings_save_one(SETTINGS_CFG_KEY, &current, sizeof(current));
+		if (ret) {
+			/* Still applied, it just won't survive a reboot. */
+			LOG_ERR("settings_save_one, error: %d", ret);
+		}
+	}
+
+	ret = changed;
+out:
+	k_mutex_unlock(&config_lock);
+	return ret;
+}
+
+int config_mod_delta_process(char *buf, size_t len)
+{
+	return config_process(buf, len, json_config_delta_parse);
+}
+
+int config_mod_shadow_process(char *buf, size_t len)
+{
+	return config_process(buf, len, json_config_shadow_parse);
+}
@@ -0,0 +1,41 @@
+#ifndef CONFIG_MODULE_H__
+#define CONFIG_MODULE_H__
+
+#include <zephyr/kernel.h>
+
+/* Runtime tunables, adjustable through the device shadow desired state. */
+struct app_config {
+	int32_t fix_interval;	/* Periodic location interval, seconds */
+	int32_t gnss_timeout;	/* GNSS method timeout, seconds */
+	int32_t cell_timeout;	/* Cellular method timeout, seconds */
+	int32_t ping_period;	/* AWS IoT ping period, seconds */
+	int32_t agnss_mask;	/* A-GNSS types to request, bit n-1 = type n */
+};
+
+/* Bits returned by config_mod_delta_process() for the fields that changed. */
+#define APP_CONFIG_FIX_INTERVAL	BIT(0)
+#define APP_CONFIG_GNSS_TIMEOUT	BIT(1)
+#define APP_CONFIG_CELL_TIMEOUT	BIT(2)
+#define APP_CONFIG_PING_PERIOD	BIT(3)
+#define APP_CONFIG_AGNSS_MASK	BIT(4)
+
+int config_mod_init(void);
+
+void config_mod_get(struct app_config *cfg);
+
+/**
+ * Parse a shadow delta document and apply any valid settings it carries.
+ * Settings are read from state.config, mirroring state.reported.config.
+ * Out of range values are rejected and the current value is kept.
+ *
+ * @return Bitmask of APP_CONFIG_* fields that changed, or a negative error.
+ */
+int config_mod_delta_process(char *buf, size_t len);
+
+/**
+ * Same as config_mod_delta_process() for the full shadow document from
+ * get/accepted, picks up desired changes made while the device was away.
+ */
+int config_mod_shadow_process(char *buf, size_t len);
+
+#endif
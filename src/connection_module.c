@@ -0,0 +1,278 @@
+#include <zephyr/logging/log.h>
+#include <zephyr/net/mqtt.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/random/random.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+#include "connection_module.h"
+
+LOG_MODULE_REGISTER(connection_module);
+
+#define CONNECTION_WQ_STACK_SIZE 3072
+#define CONNECTION_WQ_PRIORITY	 K_LOWEST_APPLICATION_THREAD_PRIO
+
+#define SETTINGS_SUBS_KEY "conn/subs"
+
+enum {
+	FLAG_AWS_READY,
+	FLAG_LTE_UP,
+	FLAG_CLEAN_SESSION,	/* Next connect must not resume the session */
+	FLAG_RESUMED,		/* Current connection resumed a session */
+};
+
+/* Shadow topics aws_iot subscribes to itself, part of the hash. */
+static const uint8_t shadow_subs[] = {
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_ACCEPTED_SUBSCRIBE),
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_REJECTED_SUBSCRIBE),
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_DELTA_SUBSCRIBE),
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_GET_ACCEPTED_SUBSCRIBE),
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_GET_REJECTED_SUBSCRIBE),
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_DELETE_ACCEPTED_SUBSCRIBE),
+	IS_ENABLED(CONFIG_AWS_IOT_TOPIC_DELETE_REJECTED_SUBSCRIBE),
+};
+
+static K_THREAD_STACK_DEFINE(connection_wq_stack, CONNECTION_WQ_STACK_SIZE);
+static struct k_work_q connection_wq;
+
+static struct aws_iot_config *aws_config;
+static atomic_t flags;
+static atomic_t attempts;
+
+static int64_t attempt_time;
+static int64_t disconnect_time;
+static struct connection_stats stats;
+
+/* Hash of the subscriptions made by this image and by the stored session */
+static uint32_t subs_hash;
+static uint32_t subs_hash_stored;
+
+static void connect_work_fn(struct k_work *work);
+static void disconnect_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(connect_work, connect_work_fn);
+static K_WORK_DEFINE(disconnect_work, disconnect_work_fn);
+
+static k_timeout_t backoff_next(void)
+{
+	int n = MIN(atomic_inc(&attempts), 16);
+	uint32_t base = MIN(CONNECTION_BACKOFF_MIN_S << n, CONNECTION_BACKOFF_MAX_S) * MSEC_PER_SEC;
+	uint32_t delay = base / 2 + sys_rand32_get() % (base / 2 + 1);
+
+	LOG_INF("Reconnecting in %d ms (attempt %d)", delay, n + 1);
+
+	return K_MSEC(delay);
+}
+
+static void reconnect_schedule(void)
+{
+	if (!atomic_test_bit(&flags, FLAG_LTE_UP)) {
+		/* Retried as soon as LTE registers again. */
+		return;
+	}
+
+	k_work_reschedule_for_queue(&connection_wq, &connect_work, backoff_next());
+}
+
+static void connect_work_fn(struct k_work *work)
+{
+	int err;
+
+	if (atomic_test_bit(&flags, FLAG_AWS_READY) ||
+	    !atomic_test_bit(&flags, FLAG_LTE_UP)) {
+		return;
+	}
+
+	attempt_time = k_uptime_get();
+
+	err = aws_iot_connect(aws_config);
+	if (err) {
+		LOG_ERR("aws_iot_connect, error: %d", err);
+		reconnect_schedule();
+	}
+}
+
+static int conn_settings_set(const char *name, size_t len,
+			     settings_read_cb read_cb, void *cb_arg)
+{
+	ssize_t rc;
+
+	if (strcmp(name, "subs") != 0 || len != sizeof(subs_hash_stored)) {
+		return -ENOENT;
+	}
+
+	rc = read_cb(cb_arg, &subs_hash_stored, sizeof(subs_hash_stored));
+
+	return rc < 0 ? rc : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(conn, "conn", NULL, conn_settings_set, NULL, NULL);
+
+int __real_mqtt_connect(struct mqtt_client *client);
+
+/* aws_iot takes the clean session flag from Kconfig and skips subscribing
+ * when the broker resumes a session, so a session made by an image with
+ * other subscriptions would be kept forever. Linked in with
+ * --wrap=mqtt_connect to force a clean session once in that case.
+ *
+ * aws_iot does not set the TLS session cache either. With it the modem
+ * resumes the TLS session on reconnect instead of a full handshake.
+ */
+int __wrap_mqtt_connect(struct mqtt_client *client)
+{
+	if (client->transport.type == MQTT_TRANSPORT_SECURE) {
+		client->transport.tls.config.session_cache = TLS_SESSION_CACHE_ENABLED;
+	}
+
+	if (atomic_test_bit(&flags, FLAG_CLEAN_SESSION)) {
+		LOG_INF("Subscriptions changed, starting a clean session");
+		client->clean_session = 1U;
+	}
+
+	return __real_mqtt_connect(client);
+}
+
+static void disconnect_work_fn(struct k_work *work)
+{
+	int err;
+
+	err = aws_iot_disconnect();
+	if (err) {
+		LOG_WRN("aws_iot_disconnect, error: %d", err);
+	}
+}
+
+int connection_mod_init(struct aws_iot_config *config,
+			const struct aws_iot_topic_data *topics, size_t count)
+{
+	int err;
+
+	aws_config = config;
+
+	subs_hash = crc32_ieee(shadow_subs, sizeof(shadow_subs));
+	for (size_t i = 0; i < count; i++) {
+		subs_hash = crc32_ieee_update(subs_hash, (const uint8_t *)topics[i].str,
+					      topics[i].len);
+		subs_hash = crc32_ieee_update(subs_hash, (const uint8_t *)"\n", 1);
+	}
+
+	err = settings_load_subtree("conn");
+	if (err) {
+		LOG_ERR("settings_load_subtree, error: %d", err);
+	}
+
+	if (!IS_ENABLED(CONFIG_MQTT_CLEAN_SESSION) && subs_hash != subs_hash_stored) {
+		atomic_set_bit(&flags, FLAG_CLEAN_SESSION);
+	}
+
+	/* Only called once the modem module has registered to LTE. */
+	atomic_set_bit(&flags, FLAG_LTE_UP);
+
+	k_work_queue_start(&connection_wq, connection_wq_stack,
+			   K_THREAD_STACK_SIZEOF(connection_wq_stack),
+			   CONNECTION_WQ_PRIORITY, NULL);
+	k_thread_name_set(&connection_wq.thread, "connection_wq");
+
+	return 0;
+}
+
+void connection_mod_start(void)
+{
+	k_work_reschedule_for_queue(&connection_wq, &connect_work, K_NO_WAIT);
+}
+
+void connection_mod_aws_evt(const struct aws_iot_evt *const evt)
+{
+	int64_t now = k_uptime_get();
+
+	switch (evt->type) {
+	case AWS_IOT_EVT_CONNECTING:
+		/* With the poll thread aws_iot_connect() returns 0 right away,
+		 * DNS, TLS and CONNACK failures are reported here instead.
+		 */
+		if (evt->data.err) {
+			LOG_WRN("AWS connect failed, error: %d", evt->data.err);
+			reconnect_schedule();
+		}
+		break;
+	case AWS_IOT_EVT_ERROR:
+		if (!atomic_test_bit(&flags, FLAG_AWS_READY)) {
+			reconnect_schedule();
+		}
+		break;
+	case AWS_IOT_EVT_CONNECTED:
+		atomic_set_bit_to(&flags, FLAG_RESUMED, evt->data.persistent_session);
+		if (evt->data.persistent_session) {
+			stats.resumed++;
+		}
+		break;
+	case AWS_IOT_EVT_READY:
+		atomic_set_bit(&flags, FLAG_AWS_READY);
+		atomic_clear(&attempts);
+
+		stats.count++;
+		stats.connect_ms = now - attempt_time;
+		stats.outage_ms = disconnect_time ? now - disconnect_time : 0;
+		disconnect_time = 0;
+
+		LOG_INF("AWS ready after %d ms, outage %d ms, session %s",
+			stats.connect_ms, stats.outage_ms,
+			atomic_test_bit(&flags, FLAG_RESUMED) ? "resumed" : "new");
+
+		/* A new session was subscribed with this image's topics */
+		if (!atomic_test_bit(&flags, FLAG_RESUMED) &&
+		    atomic_test_and_clear_bit(&flags, FLAG_CLEAN_SESSION)) {
+			int err = settings_save_one(SETTINGS_SUBS_KEY, &subs_hash,
+						    sizeof(subs_hash));
+
+			if (err) {
+				/* Costs another clean session after a reboot */
+				LOG_ERR("settings_save_one, error: %d", err);
+			}
+			subs_hash_stored = subs_hash;
+		}
+		break;
+	case AWS_IOT_EVT_DISCONNECTED:
+		atomic_clear_bit(&flags, FLAG_AWS_READY);
+		if (disconnect_time == 0) {
+			disconnect_time = now;
+		}
+		reconnect_schedule();
+		break;
+	default:
+		break;
+	}
+}
+
+void connection_mod_lte_status(bool registered)
+{
+	if (registered) {
+		if (atomic_test_and_set_bit(&flags, FLAG_LTE_UP)) {
+			return;
+		}
+
+		/* Coverage is back, connect now rather than waiting out the backoff. */
+		atomic_clear(&attempts);
+		if (aws_config && !atomic_test_bit(&flags, FLAG_AWS_READY)) {
+			k_work_reschedule_for_queue(&connection_wq, &connect_work, K_NO_WAIT);
+		}
+		return;
+	}
+
+	if (!atomic_test_and_clear_bit(&flags, FLAG_LTE_UP) || !aws_config) {
+		return;
+	}
+
+	/* The socket will not survive losing the PDN, drop it now instead of
+	 * waiting for the MQTT keepalive to notice.
+	 */
+	k_work_cancel_delayable(&connect_work);
+	if (atomic_test_bit(&flags, FLAG_AWS_READY)) {
+		k_work_submit_to_queue(&connection_wq, &disconnect_work);
+	}
+}
+
+void connection_mod_stats_get(struct connection_stats *stats_out)
+{
+	*stats_out = stats;
+}
@@ -0,0 +1,38 @@
+#ifndef CONNECTION_MODULE_H__
+#define CONNECTION_MODULE_H__
+
+#include <net/aws_iot.h>
+
+/* Reconnect backoff, a random delay in [base/2, base] where base doubles
+ * with every failed attempt up to the cap.
+ */
+#define CONNECTION_BACKOFF_MIN_S	2
+#define CONNECTION_BACKOFF_MAX_S	600
+
+struct connection_stats {
+	uint32_t count;		/* Successful connections since boot */
+	uint32_t resumed;	/* Of those, how many resumed a broker session */
+	uint32_t connect_ms;	/* Last connect attempt to AWS ready */
+	uint32_t outage_ms;	/* Last disconnect to AWS ready */
+};
+
+/**
+ * @param topics Application subscriptions given to aws_iot. When they or the
+ *		 shadow subscriptions differ from the ones the stored broker
+ *		 session was made with, the next connect is a clean session.
+ */
+int connection_mod_init(struct aws_iot_config *config,
+			const struct aws_iot_topic_data *topics, size_t count);
+
+/* Start connecting, retrying with backoff until AWS IoT is ready. */
+void connection_mod_start(void);
+
+/* Must be called from the AWS IoT event handler for every event. */
+void connection_mod_aws_evt(const struct aws_iot_evt *const evt);
+
+/* Must be called when LTE registration is gained or lost. */
+void connection_mod_lte_status(bool registered);
+
+void connection_mod_stats_get(struct connection_stats *stats);
+
+#endif
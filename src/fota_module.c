@@ -0,0 +1,285 @@
+#include <zephyr/logging/log.h>
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/reboot.h>
+
+#include "fota_module.h"
+#include "fota_patch.h"
+#include "json_common.h"
+
+LOG_MODULE_REGISTER(fota_module);
+
+/* Chunks are prefixed with their u32 offset in the patch. */
+#define CHUNK_HEADER_LEN	4
+
+#define FOTA_WQ_STACK_SIZE	2048
+#define FOTA_WQ_PRIORITY	K_LOWEST_APPLICATION_THREAD_PRIO
+#define FOTA_REBOOT_DELAY	K_SECONDS(5)
+
+static const char *const state_str[] = {
+	[FOTA_IDLE] = "idle",
+	[FOTA_DOWNLOADING] = "downloading",
+	[FOTA_READY] = "ready",
+	[FOTA_FAILED] = "failed",
+};
+
+static K_THREAD_STACK_DEFINE(fota_wq_stack, FOTA_WQ_STACK_SIZE);
+static struct k_work_q fota_wq;
+
+static fota_publish_t publish_fn;
+static fota_status_handler_t status_fn;
+
+static enum fota_state state;
+static int32_t last_err;
+static char version[FOTA_VERSION_LEN];
+static uint32_t total_size;
+static uint32_t offset;
+static int retries;
+static int32_t reported_progress;
+
+static struct fota_patch patch;
+static struct flash_img_context img_ctx;
+static const struct flash_area *primary;
+
+static uint8_t chunk_buf[FOTA_CHUNK_SIZE];
+static size_t chunk_len;
+static atomic_t chunk_busy;
+
+static void chunk_work_fn(struct k_work *work);
+static void timeout_work_fn(struct k_work *work);
+static void reboot_work_fn(struct k_work *work);
+
+static K_WORK_DEFINE(chunk_work, chunk_work_fn);
+static K_WORK_DELAYABLE_DEFINE(timeout_work, timeout_work_fn);
+static K_WORK_DELAYABLE_DEFINE(reboot_work, reboot_work_fn);
+
+static int request_chunk(void)
+{
+	char buf[64];
+	int err;
+	struct fota_chunk_request payload = {
+		.offset = offset,
+		.size = MIN(FOTA_CHUNK_SIZE - CHUNK_HEADER_LEN, total_size - offset),
+	};
+
+	k_work_reschedule_for_queue(&fota_wq, &timeout_work, FOTA_CHUNK_TIMEOUT);
+
+	err = json_fota_chunk_request_construct(buf, sizeof(buf), &payload);
+	if (err) {
+		return err;
+	}
+
+	/* A failed publish is retried by the timeout like a lost answer. */
+	err = publish_fn(buf, strlen(buf));
+	if (err) {
+		LOG_WRN("FOTA chunk request at %d not sent, error: %d", offset, err);
+	}
+
+	return 0;
+}
+
+static void fota_fail(int err)
+{
+	LOG_ERR("FOTA failed at offset %d, error: %d", offset, err);
+
+	k_work_cancel_delayable(&timeout_work);
+	last_err = err;
+	state = FOTA_FAILED;
+	status_fn();
+}
+
+static int fota_finish(void)
+{
+	int err;
+
+	err = fota_patch_finish(&patch);
+	if (err) {
+		return err;
+	}
+
+	err = boot_request_upgrade(BOOT_UPGRADE_TEST);
+	if (err) {
+		return err;
+	}
+
+	LOG_INF("FOTA %s ready, rebooting to swap", version);
+
+	state = FOTA_READY;
+	status_fn();
+	k_work_reschedule_for_queue(&fota_wq, &reboot_work, FOTA_REBOOT_DELAY);
+
+	return 0;
+}
+
+static void chunk_work_fn(struct k_work *work)
+{
+	int err;
+	int32_t progress;
+
+	k_work_cancel_delayable(&timeout_work);
+
+	err = fota_patch_feed(&patch, chunk_buf, chunk_len);
+	offset += chunk_len;
+	atomic_clear(&chunk_busy);
+
+	if (err) {
+		fota_fail(err);
+		return;
+	}
+
+	retries = 0;
+
+	if (offset >= total_size) {
+		err = fota_finish();
+		if (err) {
+			fota_fail(err);
+		}
+		return;
+	}
+
+	progress = (int64_t)offset * 100 / total_size;
+	if (progress / 10 != reported_progress / 10) {
+		reported_progress = progress;
+		status_fn();
+	}
+
+	request_chunk();
+}
+
+static void timeout_work_fn(struct k_work *work)
+{
+	if (state != FOTA_DOWNLOADING) {
+		return;
+	}
+
+	if (++retries > FOTA_CHUNK_RETRIES) {
+		fota_fail(-ETIMEDOUT);
+		return;
+	}
+
+	LOG_WRN("FOTA chunk at %d timed out, retry %d", offset, retries);
+	request_chunk();
+}
+
+static void reboot_work_fn(struct k_work *work)
+{
+	sys_reboot(SYS_REBOOT_WARM);
+}
+
+int fota_mod_init(fota_publish_t publish, fota_status_handler_t status_handler)
+{
+	int err;
+
+	publish_fn = publish;
+	status_fn = status_handler;
+
+	k_work_queue_start(&fota_wq, fota_wq_stack,
+			   K_THREAD_STACK_SIZEOF(fota_wq_stack),
+			   FOTA_WQ_PRIORITY, NULL);
+	k_thread_name_set(&fota_wq.thread, "fota_wq");
+
+	/* An image that never reaches the cloud must not stay running, only
+	 * a reset lets MCUboot revert it.
+	 */
+	if (mcuboot_swap_type() == BOOT_SWAP_TYPE_REVERT) {
+		LOG_WRN("Running a test image, rebooting unless confirmed in time");
+		k_work_reschedule_for_queue(&fota_wq, &reboot_work, FOTA_CONFIRM_TIMEOUT);
+	}
+
+	err = flash_area_open(FIXED_PARTITION_ID(slot0_partition), &primary);
+	if (err) {
+		LOG_ERR("flash_area_open, error: %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+void fota_mod_confirm(void)
+{
+	int err;
+
+	if (boot_is_img_confirmed()) {
+		return;
+	}
+
+	err = boot_write_img_confirmed();
+	if (err) {
+		/* Left to the confirm deadline, which reverts the image */
+		LOG_ERR("boot_write_img_confirmed, error: %d", err);
+		return;
+	}
+
+	k_work_cancel_delayable(&reboot_work);
+	LOG_INF("Running image confirmed");
+}
+
+int fota_mod_job(char *buf, size_t len)
+{
+	int err;
+	struct fota_job job = {0};
+
+	if (state == FOTA_DOWNLOADING || state == FOTA_READY) {
+		return -EBUSY;
+	}
+
+	err = json_fota_job_parse(buf, len, &job);
+	if (err) {
+		return err;
+	}
+
+	if (job.size <= FOTA_PATCH_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	err = flash_img_init(&img_ctx);
+	if (err) {
+		LOG_ERR("flash_img_init, error: %d", err);
+		return err;
+	}
+
+	fota_patch_init(&patch, primary, &img_ctx);
+
+	strncpy(version, job.version ? job.version : "", sizeof(version) - 1);
+	version[sizeof(version) - 1] = '\0';
+	total_size = job.size;
+	offset = 0;
+	retries = 0;
+	reported_progress = 0;
+	last_err = 0;
+	state = FOTA_DOWNLOADING;
+
+	LOG_INF("FOTA %s started, %d byte patch", version, total_size);
+	status_fn();
+
+	return request_chunk();
+}
+
+int fota_mod_data(const char *buf, size_t len)
+{
+	if (state != FOTA_DOWNLOADING || len <= CHUNK_HEADER_LEN ||
+	    len > sizeof(chunk_buf) + CHUNK_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	/* Late answers to a retried request carry an old offset, drop them. */
+	if (sys_get_le32(buf) != offset || atomic_set(&chunk_busy, 1)) {
+		return -EALREADY;
+	}
+
+	chunk_len = len - CHUNK_HEADER_LEN;
+	memcpy(chunk_buf, buf + CHUNK_HEADER_LEN, chunk_len);
+	k_work_submit_to_queue(&fota_wq, &chunk_work);
+
+	return 0;
+}
+
+void fota_mod_status_get(struct fota_status *status)
+{
+	status->state = state_str[state];
+	status->progress = state == FOTA_READY ? 100 : reported_progress;
+	status->err = last_err;
+	status->version = version;
+}
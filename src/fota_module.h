@@ -0,0 +1,58 @@
+#ifndef FOTA_MODULE_H__
+#define FOTA_MODULE_H__
+
+#include <zephyr/kernel.h>
+
+/* Bytes asked for per fota/<client>/get request, must fit the MQTT
+ * payload buffer.
+ */
+#define FOTA_CHUNK_SIZE		4096
+
+#define FOTA_CHUNK_TIMEOUT	K_SECONDS(30)
+#define FOTA_CHUNK_RETRIES	5
+
+#define FOTA_VERSION_LEN	16
+
+/* A test image that has not confirmed itself by then reboots, MCUboot then
+ * reverts to the previous image. Covers a few reconnect backoff rounds.
+ */
+#define FOTA_CONFIRM_TIMEOUT	K_MINUTES(15)
+
+/* Patch format and application in fota_patch.h. */
+
+enum fota_state {
+	FOTA_IDLE,
+	FOTA_DOWNLOADING,
+	FOTA_READY,	/* Verified, reboot pending to swap */
+	FOTA_FAILED,
+};
+
+struct fota_status {
+	const char *state;
+	int32_t progress;	/* percent */
+	int32_t err;
+	const char *version;
+};
+
+/* Publishes a chunk request document, returns 0 once handed to MQTT. */
+typedef int (*fota_publish_t)(const char *buf, size_t len);
+
+/* Called whenever the status changes enough to be worth reporting. */
+typedef void (*fota_status_handler_t)(void);
+
+int fota_mod_init(fota_publish_t publish, fota_status_handler_t status_handler);
+
+/* Mark the running image good, call once the cloud connection works.
+ * Until then a test image is rebooted after FOTA_CONFIRM_TIMEOUT.
+ */
+void fota_mod_confirm(void);
+
+/* Start an update from a job document {"size":N,"version":"x.y.z"}. */
+int fota_mod_job(char *buf, size_t len);
+
+/* Feed the next chunk of the patch, as answered on fota/<client>/data. */
+int fota_mod_data(const char *buf, size_t len);
+
+void fota_mod_status_get(struct fota_status *status);
+
+#endif
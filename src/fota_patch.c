@@ -0,0 +1,211 @@
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "fota_patch.h"
+
+LOG_MODULE_REGISTER(fota_patch);
+
+#define PATCH_OP_END		0x00
+#define PATCH_OP_COPY		0x01
+#define PATCH_OP_INSERT		0x02
+
+static int patch_write(struct fota_patch *patch, const uint8_t *data, size_t len)
+{
+	if (patch->written + len > patch->target_size) {
+		return -EFBIG;
+	}
+
+	patch->written += len;
+
+	return flash_img_buffered_write(patch->img, data, len, false);
+}
+
+static int patch_copy(struct fota_patch *patch, uint32_t src, uint32_t len)
+{
+	int err;
+
+	if (src > patch->source_size || len > patch->source_size - src) {
+		return -EINVAL;
+	}
+
+	while (len) {
+		size_t n = MIN(len, sizeof(patch->copy_buf));
+
+		err = flash_area_read(patch->source, src, patch->copy_buf, n);
+		if (err) {
+			return err;
+		}
+
+		err = patch_write(patch, patch->copy_buf, n);
+		if (err) {
+			return err;
+		}
+
+		src += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int patch_header(struct fota_patch *patch)
+{
+	int err;
+	struct flash_area_check fac;
+
+	if (sys_get_le32(&patch->buf[0]) != FOTA_PATCH_MAGIC) {
+		return -EBADMSG;
+	}
+
+	patch->source_size = sys_get_le32(&patch->buf[4]);
+	patch->target_size = sys_get_le32(&patch->buf[8]);
+	memcpy(patch->target_hash, &patch->buf[44], sizeof(patch->target_hash));
+
+	if (patch->source_size > patch->source->fa_size ||
+	    patch->target_size > patch->source->fa_size) {
+		return -EFBIG;
+	}
+
+	/* A patch only makes sense against the image it was made from. */
+	fac = (struct flash_area_check){
+		.match = &patch->buf[12],
+		.clen = patch->source_size,
+		.off = 0,
+		.rbuf = patch->copy_buf,
+		.rblen = sizeof(patch->copy_buf),
+	};
+
+	err = flash_area_check_int_sha256(patch->source, &fac);
+	if (err) {
+		LOG_ERR("Patch does not match the source image");
+		return -ENOEXEC;
+	}
+
+	LOG_INF("Patching %d byte image to %d bytes", patch->source_size,
+		patch->target_size);
+
+	return 0;
+}
+
+static int patch_args(struct fota_patch *patch)
+{
+	uint32_t a = sys_get_le32(&patch->buf[0]);
+
+	if (patch->op == PATCH_OP_COPY) {
+		patch->state = FOTA_PATCH_OP;
+		return patch_copy(patch, a, sys_get_le32(&patch->buf[4]));
+	}
+
+	patch->insert_left = a;
+	patch->state = a ? FOTA_PATCH_INSERT : FOTA_PATCH_OP;
+
+	return 0;
+}
+
+void fota_patch_init(struct fota_patch *patch, const struct flash_area *source,
+		     struct flash_img_context *img)
+{
+	memset(patch, 0, sizeof(*patch));
+	patch->source = source;
+	patch->img = img;
+	patch->state = FOTA_PATCH_HEADER;
+	patch->need = FOTA_PATCH_HEADER_LEN;
+}
+
+int fota_patch_feed(struct fota_patch *patch, const uint8_t *data, size_t len)
+{
+	int err = 0;
+
+	while (len && !err) {
+		size_t take;
+
+		switch (patch->state) {
+		case FOTA_PATCH_HEADER:
+		case FOTA_PATCH_ARGS:
+			take = MIN(patch->need - patch->buf_len, len);
+			memcpy(&patch->buf[patch->buf_len], data, take);
+			patch->buf_len += take;
+			data += take;
+			len -= take;
+
+			if (patch->buf_len < patch->need) {
+				break;
+			}
+
+			if (patch->state == FOTA_PATCH_HEADER) {
+				err = patch_header(patch);
+				patch->state = FOTA_PATCH_OP;
+			} else {
+				err = patch_args(patch);
+			}
+			break;
+
+		case FOTA_PATCH_OP:
+			patch->op = *data++;
+			len--;
+			patch->buf_len = 0;
+
+			if (patch->op == PATCH_OP_COPY) {
+				patch->need = 8;
+				patch->state = FOTA_PATCH_ARGS;
+			} else if (patch->op == PATCH_OP_INSERT) {
+				patch->need = 4;
+				patch->state = FOTA_PATCH_ARGS;
+			} else if (patch->op == PATCH_OP_END) {
+				patch->state = FOTA_PATCH_END;
+			} else {
+				err = -EBADMSG;
+			}
+			break;
+
+		case FOTA_PATCH_INSERT:
+			take = MIN(patch->insert_left, len);
+			err = patch_write(patch, data, take);
+			patch->insert_left -= take;
+			data += take;
+			len -= take;
+
+			if (patch->insert_left == 0) {
+				patch->state = FOTA_PATCH_OP;
+			}
+			break;
+
+		case FOTA_PATCH_END:
+			/* Nothing may follow END. */
+			err = -EBADMSG;
+			break;
+		}
+	}
+
+	return err;
+}
+
+int fota_patch_finish(struct fota_patch *patch)
+{
+	int err;
+	struct flash_img_check fic = {
+		.match = patch->target_hash,
+		.clen = patch->target_size,
+	};
+
+	if (patch->state != FOTA_PATCH_END || patch->written != patch->target_size) {
+		return -EBADMSG;
+	}
+
+	err = flash_img_buffered_write(patch->img, NULL, 0, true);
+	if (err) {
+		return err;
+	}
+
+	/* Verify what actually landed in flash before asking for the swap.
+	 * MCUboot checks the image signature again on boot.
+	 */
+	err = flash_img_check(patch->img, &fic, flash_img_get_upload_slot());
+	if (err) {
+		LOG_ERR("Patched image hash mismatch");
+		return err;
+	}
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef FOTA_PATCH_H__
+#define FOTA_PATCH_H__
+
+#include <zephyr/kernel.h>
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/storage/flash_map.h>
+
+/*
+ * Delta patch format, all integers little endian:
+ *
+ *   header: u32 magic "DPT1", u32 source size, u32 target size,
+ *           u8 source sha256[32], u8 target sha256[32]
+ *   ops:    0x01 COPY   u32 source offset, u32 length
+ *           0x02 INSERT u32 length, followed by length literal bytes
+ *           0x00 END
+ *
+ * The source is read from a flash area, the target is written through
+ * flash_img to the upload slot as the patch streams in.
+ */
+#define FOTA_PATCH_MAGIC	0x31545044
+#define FOTA_PATCH_HEADER_LEN	76
+
+#define FOTA_PATCH_COPY_BUF_SIZE 256
+
+enum fota_patch_state {
+	FOTA_PATCH_HEADER,
+	FOTA_PATCH_OP,
+	FOTA_PATCH_ARGS,
+	FOTA_PATCH_INSERT,
+	FOTA_PATCH_END,
+};
+
+struct fota_patch {
+	const struct flash_area *source;
+	struct flash_img_context *img;
+
+	enum fota_patch_state state;
+	uint8_t buf[FOTA_PATCH_HEADER_LEN];	/* Header or op arguments */
+	size_t buf_len;
+	size_t need;
+	uint8_t op;
+	uint32_t source_size;
+	uint32_t target_size;
+	uint8_t target_hash[32];
+	uint32_t insert_left;
+	uint32_t written;
+	uint8_t copy_buf[FOTA_PATCH_COPY_BUF_SIZE];
+};
+
+/**
+ * Start a patch against the image in source. img must already be set up
+ * with flash_img_init().
+ */
+void fota_patch_init(struct fota_patch *patch, const struct flash_area *source,
+		     struct flash_img_context *img);
+
+/**
+ * Consume patch bytes, any split across calls is fine.
+ *
+ * @retval -ENOEXEC The patch was not made from the source image.
+ * @retval -EBADMSG Malformed patch or data after END.
+ */
+int fota_patch_feed(struct fota_patch *patch, const uint8_t *data, size_t len);
+
+/**
+ * Flush the target and verify it against the target hash in the header.
+ *
+ * @retval -EBADMSG The patch ended before END or wrote too few bytes.
+ */
+int fota_patch_finish(struct fota_patch *patch);
+
+#endif
@@ -0,0 +1,441 @@
+#include <math.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include "geofence_module.h"
+#include "json_common.h"
+
+LOG_MODULE_REGISTER(geofence_module);
+
+/* Uniform grid over the bounding box of all fences. Each cell lists the
+ * fences whose bounding box overlaps it, stored as one flat array indexed
+ * by cell_start so the whole index is a few KB.
+ */
+#define GRID_DIM		16
+#define GRID_CELLS		(GRID_DIM * GRID_DIM)
+#define GRID_ENTRIES_MAX	2048
+
+#define METERS_PER_DEGREE	111320.0
+#define DEG_TO_RAD		(M_PI / 180.0)
+
+struct bbox {
+	int32_t min_lat;
+	int32_t min_lon;
+	int32_t max_lat;
+	int32_t max_lon;
+};
+
+struct fence {
+	int32_t id;
+	uint32_t radius;	/* metres, 0 for a polygon */
+	uint16_t first;		/* index into vertices */
+	uint8_t count;
+	struct bbox box;
+};
+
+struct vertex {
+	int32_t lat;
+	int32_t lon;
+};
+
+static struct fence fences[GEOFENCE_MAX];
+static struct vertex vertices[GEOFENCE_VERTEX_MAX];
+static size_t fence_count;
+static size_t vertex_count;
+
+static struct bbox grid_box;
+static int32_t cell_lat;
+static int32_t cell_lon;
+static uint16_t cell_start[GRID_CELLS + 1];
+static uint16_t cell_entries[GRID_ENTRIES_MAX];
+static bool grid_valid;
+
+static ATOMIC_DEFINE(inside, GEOFENCE_MAX);
+
+static geofence_handler_t event_handler;
+static struct geofence_msg msg;
+
+static K_MUTEX_DEFINE(geofence_lock);
+
+/* Transitions waiting to be published, oldest first. */
+static struct geofence_event queue[GEOFENCE_QUEUE_MAX];
+static size_t queue_head;
+static size_t queue_len;
+
+static K_MUTEX_DEFINE(queue_lock);
+
+static void flush_work_fn(struct k_work *work)
+{
+	struct geofence_event evt;
+	int err;
+
+	if (!event_handler) {
+		return;
+	}
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+
+	while (queue_len) {
+		evt = queue[queue_head];
+		err = event_handler(&evt);
+		if (err) {
+			/* Keep it for the next flush, order matters to the backend */
+			LOG_WRN("Geofence event %d held, %zu queued, error: %d",
+				evt.id, queue_len, err);
+			break;
+		}
+		queue_head = (queue_head + 1) % GEOFENCE_QUEUE_MAX;
+		queue_len--;
+	}
+
+	k_mutex_unlock(&queue_lock);
+}
+
+static K_WORK_DEFINE(flush_work, flush_work_fn);
+
+static void event_queue(const struct geofence_event *evt)
+{
+	k_mutex_lock(&queue_lock, K_FOREVER);
+
+	if (queue_len == GEOFENCE_QUEUE_MAX) {
+		LOG_WRN("Geofence queue full, dropping event for %d",
+			queue[queue_head].id);
+		queue_head = (queue_head + 1) % GEOFENCE_QUEUE_MAX;
+		queue_len--;
+	}
+	queue[(queue_head + queue_len) % GEOFENCE_QUEUE_MAX] = *evt;
+	queue_len++;
+
+	k_mutex_unlock(&queue_lock);
+
+	k_work_submit(&flush_work);
+}
+
+static bool bbox_contains(const struct bbox *box, int32_t lat, int32_t lon)
+{
+	return lat >= box->min_lat && lat <= box->max_lat &&
+	       lon >= box->min_lon && lon <= box->max_lon;
+}
+
+static int cell_coord(int32_t val, int32_t min, int32_t size)
+{
+	return CLAMP((val - min) / size, 0, GRID_DIM - 1);
+}
+
+static void grid_build(void)
+{
+	static uint16_t cursor[GRID_CELLS];
+	size_t total = 0;
+
+	grid_valid = false;
+	if (fence_count == 0) {
+		return;
+	}
+
+	grid_box = fences[0].box;
+	for (size_t i = 1; i < fence_count; i++) {
+		grid_box.min_lat = MIN(grid_box.min_lat, fences[i].box.min_lat);
+		grid_box.min_lon = MIN(grid_box.min_lon, fences[i].box.min_lon);
+		grid_box.max_lat = MAX(grid_box.max_lat, fences[i].box.max_lat);
+		grid_box.max_lon = MAX(grid_box.max_lon, fences[i].box.max_lon);
+	}
+
+	cell_lat = (grid_box.max_lat - grid_box.min_lat) / GRID_DIM + 1;
+	cell_lon = (grid_box.max_lon - grid_box.min_lon) / GRID_DIM + 1;
+
+	/* First pass counts entries per cell, second pass fills them in. */
+	memset(cursor, 0, sizeof(cursor));
+	for (size_t i = 0; i < fence_count; i++) {
+		const struct bbox *box = &fences[i].box;
+		int r0 = cell_coord(box->min_lat, grid_box.min_lat, cell_lat);
+		int r1 = cell_coord(box->max_lat, grid_box.min_lat, cell_lat);
+		int c0 = cell_coord(box->min_lon, grid_box.min_lon, cell_lon);
+		int c1 = cell_coord(box->max_lon, grid_box.min_lon, cell_lon);
+
+		for (int r = r0; r <= r1; r++) {
+			for (int c = c0; c <= c1; c++) {
+				cursor[r * GRID_DIM + c]++;
+			}
+		}
+		total += (r1 - r0 + 1) * (c1 - c0 + 1);
+	}
+
+	if (total > GRID_ENTRIES_MAX) {
+		LOG_WRN("Geofence index full (%zu entries), using linear scan", total);
+		return;
+	}
+
+	cell_start[0] = 0;
+	for (int i = 0; i < GRID_CELLS; i++) {
+		cell_start[i + 1] = cell_start[i] + cursor[i];
+		cursor[i] = cell_start[i];
+	}
+
+	for (size_t i = 0; i < fence_count; i++) {
+		const struct bbox *box = &fences[i].box;
+		int r0 = cell_coord(box->min_lat, grid_box.min_lat, cell_lat);
+		int r1 = cell_coord(box->max_lat, grid_box.min_lat, cell_lat);
+		int c0 = cell_coord(box->min_lon, grid_box.min_lon, cell_lon);
+		int c1 = cell_coord(box->max_lon, grid_box.min_lon, cell_lon);
+
+		for (int r = r0; r <= r1; r++) {
+			for (int c = c0; c <= c1; c++) {
+				cell_entries[cursor[r * GRID_DIM + c]++] = i;
+			}
+		}
+	}
+
+	grid_valid = true;
+}
+
+static double segment_distance(double ax, double ay, double bx, double by)
+{
+	/* Distance from the origin to segment a-b. */
+	double dx = bx - ax;
+	double dy = by - ay;
+	double len2 = dx * dx + dy * dy;
+	double t = 0.0;
+
+	if (len2 > 0.0) {
+		t = CLAMP(-(ax * dx + ay * dy) / len2, 0.0, 1.0);
+	}
+
+	return sqrt((ax + t * dx) * (ax + t * dx) + (ay + t * dy) * (ay + t * dy));
+}
+
+/* Signed distance in metres from the point to the fence edge, negative when
+ * inside. Uses an equirectangular projection centred on the point, which is
+ * accurate enough at fence scale away from the poles and antimeridian.
+ */
+static double fence_distance(const struct fence *f, int32_t lat, int32_t lon,
+			     double lon_scale)
+{
+	const struct vertex *v = &vertices[f->first];
+	double min_dist = INFINITY;
+	bool in = false;
+
+	if (f->radius) {
+		double x = (v->lon - lon) * lon_scale;
+		double y = (v->lat - lat) * (METERS_PER_DEGREE / 1e6);
+
+		return sqrt(x * x + y * y) - f->radius;
+	}
+
+	for (int i = 0, j = f->count - 1; i < f->count; j = i++) {
+		double xi = (v[i].lon - lon) * lon_scale;
+		double yi = (v[i].lat - lat) * (METERS_PER_DEGREE / 1e6);
+		double xj = (v[j].lon - lon) * lon_scale;
+		double yj = (v[j].lat - lat) * (METERS_PER_DEGREE / 1e6);
+
+		/* Ray cast along +x from the origin. */
+		if ((yi > 0.0) != (yj > 0.0) &&
+		    0.0 < xi + (0.0 - yi) * (xj - xi) / (yj - yi)) {
+			in = !in;
+		}
+
+		min_dist = MIN(min_dist, segment_distance(xi, yi, xj, yj));
+	}
+
+	return in ? -min_dist : min_dist;
+}
+
+static void fence_check(size_t idx, int32_t lat, int32_t lon, double lon_scale,
+			double margin)
+{
+	const struct fence *f = &fences[idx];
+	double dist = fence_distance(f, lat, lon, lon_scale);
+	struct geofence_event evt = {
+		.id = f->id,
+		.lat = lat,
+		.lon = lon,
+	};
+
+	if (!atomic_test_bit(inside, idx) && dist < -margin) {
+		atomic_set_bit(inside, idx);
+		evt.transition = GEOFENCE_ENTER;
+	} else if (atomic_test_bit(inside, idx) && dist > margin) {
+		atomic_clear_bit(inside, idx);
+		evt.transition = GEOFENCE_EXIT;
+	} else {
+		return;
+	}
+
+	LOG_INF("Geofence %d %s", f->id,
+		evt.transition == GEOFENCE_ENTER ? "enter" : "exit");
+
+	event_queue(&evt);
+}
+
+static int fence_add(const struct geofence_desc *desc)
+{
+	struct fence *f;
+	size_t count = desc->pts_len / 2;
+
+	if (fence_count >= GEOFENCE_MAX) {
+		return -ENOMEM;
+	}
+
+	if (desc->radius > 0 ? count < 1 : count < 3) {
+		return -EINVAL;
+	}
+
+	/* Entering needs a point GEOFENCE_HYSTERESIS_M inside the edge */
+	if (desc->radius > 0 && desc->radius <= GEOFENCE_HYSTERESIS_M) {
+		LOG_WRN("Geofence %d radius %d m can never be entered",
+			desc->id, desc->radius);
+		return -EINVAL;
+	}
+
+	if (desc->radius > 0) {
+		count = 1;
+	}
+
+	if (vertex_count + count > GEOFENCE_VERTEX_MAX) {
+		return -ENOMEM;
+	}
+
+	f = &fences[fence_count];
+	f->id = desc->id;
+	f->radius = MAX(desc->radius, 0);
+	f->first = vertex_count;
+	f->count = count;
+	f->box = (struct bbox){ INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+
+	for (size_t i = 0; i < count; i++) {
+		struct vertex *v = &vertices[vertex_count + i];
+
+		v->lat = desc->pts[2 * i];
+		v->lon = desc->pts[2 * i + 1];
+		f->box.min_lat = MIN(f->box.min_lat, v->lat);
+		f->box.min_lon = MIN(f->box.min_lon, v->lon);
+		f->box.max_lat = MAX(f->box.max_lat, v->lat);
+		f->box.max_lon = MAX(f->box.max_lon, v->lon);
+	}
+
+	if (!f->radius) {
+		double height = (f->box.max_lat - f->box.min_lat) *
+				(METERS_PER_DEGREE / 1e6);
+		double width = (f->box.max_lon - f->box.min_lon) *
+			       (METERS_PER_DEGREE / 1e6) *
+			       cos((f->box.min_lat / 2 + f->box.max_lat / 2) / 1e6 * DEG_TO_RAD);
+
+		/* No point of a polygon this narrow is far enough inside */
+		if (MIN(height, width) <= 2 * GEOFENCE_HYSTERESIS_M) {
+			LOG_WRN("Geofence %d is %d x %d m, can never be entered",
+				desc->id, (int)width, (int)height);
+			return -EINVAL;
+		}
+	}
+
+	if (f->radius) {
+		int32_t dlat = f->radius / METERS_PER_DEGREE * 1e6;
+		int32_t dlon = dlat / MAX(cos(f->box.min_lat / 1e6 * DEG_TO_RAD), 0.01);
+
+		f->box.min_lat -= dlat;
+		f->box.max_lat += dlat;
+		f->box.min_lon -= dlon;
+		f->box.max_lon += dlon;
+	}
+
+	vertex_count += count;
+	fence_count++;
+
+	return 0;
+}
+
+int geofence_mod_init(geofence_handler_t handler)
+{
+	event_handler = handler;
+
+	return 0;
+}
+
+int geofence_mod_load(char *buf, size_t len)
+{
+	int err;
+	int loaded = 0;
+
+	k_mutex_lock(&geofence_lock, K_FOREVER);
+
+	err = json_geofence_parse(buf, len, &msg);
+	if (err) {
+		goto out;
+	}
+
+	if (msg.clear) {
+		fence_count = 0;
+		vertex_count = 0;
+		for (int i = 0; i < GEOFENCE_MAX; i++) {
+			atomic_clear_bit(inside, i);
+		}
+	}
+
+	for (size_t i = 0; i < msg.fences_len; i++) {
+		err = fence_add(&msg.fences[i]);
+		if (err) {
+			LOG_WRN("Geofence %d rejected, error: %d", msg.fences[i].id, err);
+			continue;
+		}
+		loaded++;
+	}
+
+	grid_build();
+
+	LOG_INF("Loaded %d geofences, %zu total", loaded, fence_count);
+	err = loaded;
+out:
+	k_mutex_unlock(&geofence_lock);
+	return err;
+}
+
+void geofence_mod_evaluate(double latitude, double longitude, float accuracy)
+{
+	ATOMIC_DEFINE(visited, GEOFENCE_MAX) = {0};
+	int32_t lat = latitude * 1e6;
+	int32_t lon = longitude * 1e6;
+	double lon_scale = METERS_PER_DEGREE / 1e6 * cos(latitude * DEG_TO_RAD);
+	double margin = MAX((double)GEOFENCE_HYSTERESIS_M, (double)accuracy);
+
+	k_mutex_lock(&geofence_lock, K_FOREVER);
+
+	if (!grid_valid) {
+		for (size_t i = 0; i < fence_count; i++) {
+			if (bbox_contains(&fences[i].box, lat, lon) ||
+			    atomic_test_bit(inside, i)) {
+				fence_check(i, lat, lon, lon_scale, margin);
+			}
+		}
+		goto out;
+	}
+
+	/* Only fences in this cell can be entered. */
+	if (bbox_contains(&grid_box, lat, lon)) {
+		int cell = cell_coord(lat, grid_box.min_lat, cell_lat) * GRID_DIM +
+			   cell_coord(lon, grid_box.min_lon, cell_lon);
+
+		for (int i = cell_start[cell]; i < cell_start[cell + 1]; i++) {
+			size_t idx = cell_entries[i];
+
+			atomic_set_bit(visited, idx);
+			if (bbox_contains(&fences[idx].box, lat, lon) ||
+			    atomic_test_bit(inside, idx)) {
+				fence_check(idx, lat, lon, lon_scale, margin);
+			}
+		}
+	}
+
+	/* Fences we were inside can be exited from anywhere. */
+	for (size_t i = 0; i < fence_count; i++) {
+		if (atomic_test_bit(inside, i) && !atomic_test_bit(visited, i)) {
+			fence_check(i, lat, lon, lon_scale, margin);
+		}
+	}
+
+out:
+	k_mutex_unlock(&geofence_lock);
+}
+
+void geofence_mod_flush(void)
+{
+	k_work_submit(&flush_work);
+}
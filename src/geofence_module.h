@@ -0,0 +1,62 @@
+#ifndef GEOFENCE_MODULE_H__
+#define GEOFENCE_MODULE_H__
+
+#include <zephyr/kernel.h>
+
+/* Fence storage, sized for a few hundred fences without using the heap. */
+#define GEOFENCE_MAX			256
+#define GEOFENCE_VERTEX_MAX		1024
+#define GEOFENCE_POLY_VERTICES_MAX	16
+
+/* Fences accepted in a single MQTT message. */
+#define GEOFENCE_MSG_MAX		16
+
+/* Minimum distance past a boundary before a transition is reported. */
+#define GEOFENCE_HYSTERESIS_M		25
+
+/* Transitions held while they cannot be published, the oldest is dropped
+ * when full.
+ */
+#define GEOFENCE_QUEUE_MAX		16
+
+enum geofence_transition {
+	GEOFENCE_ENTER,
+	GEOFENCE_EXIT,
+};
+
+struct geofence_event {
+	int32_t id;
+	enum geofence_transition transition;
+	int32_t lat;	/* microdegrees */
+	int32_t lon;	/* microdegrees */
+};
+
+/* Publishes a transition, a non-zero return keeps it queued for the next
+ * geofence_mod_flush().
+ */
+typedef int (*geofence_handler_t)(const struct geofence_event *evt);
+
+int geofence_mod_init(geofence_handler_t handler);
+
+/**
+ * Load fences from a JSON document:
+ * {"clear":true,"fences":[{"id":1,"radius":150,"pts":[lat,lon,...]}]}
+ * Coordinates are microdegrees. A non-zero radius makes a circle centred on
+ * the first point, otherwise pts is a polygon of up to
+ * GEOFENCE_POLY_VERTICES_MAX vertices.
+ *
+ * Fences too small to ever be entered with the GEOFENCE_HYSTERESIS_M margin
+ * are rejected: circles up to that radius and polygons up to twice that
+ * across.
+ *
+ * @return Number of fences loaded, or a negative error.
+ */
+int geofence_mod_load(char *buf, size_t len);
+
+/* Evaluate a fix and queue every enter/exit transition for the handler. */
+void geofence_mod_evaluate(double lat, double lon, float accuracy);
+
+/* Retry queued transitions, call once the cloud connection is back. */
+void geofence_mod_flush(void);
+
+#endif
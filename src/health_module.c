@@ -0,0 +1,195 @@
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/sys_heap.h>
+#include <zephyr/version.h>
+
+#ifdef HEALTH_HEAP_FRAG
+/* Allocator internals from lib/heap, for reading the free lists. Private
+ * to Zephyr, checked against Zephyr 3.4 (nRF Connect SDK 2.5) only.
+ */
+#include <heap.h>
+
+#if KERNEL_VERSION_NUMBER >= ZEPHYR_VERSION(3, 5, 0)
+#error "heap_largest_block() needs checking against this Zephyr's lib/heap, or build without HEALTH_HEAP_FRAG"
+#endif
+#endif
+
+#include "health_module.h"
+
+LOG_MODULE_REGISTER(health_module);
+
+#define HEALTH_PROBE_PERIOD K_SECONDS(5)
+
+/* Backs k_malloc(), sized by CONFIG_HEAP_MEM_POOL_SIZE. */
+extern struct k_heap _system_heap;
+
+static uint32_t probe_cycles;
+static atomic_t wq_latency_us;
+static atomic_t wq_latency_max_us;
+static uint32_t last_alerts;
+
+static void probe_work_fn(struct k_work *work)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - probe_cycles);
+
+	atomic_set(&wq_latency_us, us);
+	if (us > atomic_get(&wq_latency_max_us)) {
+		atomic_set(&wq_latency_max_us, us);
+	}
+}
+
+static K_WORK_DEFINE(probe_work, probe_work_fn);
+
+static void probe_timer_fn(struct k_timer *timer)
+{
+	/* Skip if the previous probe has not run yet, the max already shows it. */
+	if (k_work_busy_get(&probe_work)) {
+		return;
+	}
+
+	probe_cycles = k_cycle_get_32();
+	k_work_submit(&probe_work);
+}
+
+static K_TIMER_DEFINE(probe_timer, probe_timer_fn, NULL);
+
+/* Free chunks looked at in the top bucket, bounds the time under the lock. */
+#define HEAP_BUCKET_WALK_MAX	16
+
+/* Threads reported in the shadow, in this order. Other threads are only
+ * checked for the stack alert.
+ */
+static const char *const watched_threads[] = {
+	"main",
+	"sysworkq",
+	"connection_poll_thread",	/* aws_iot */
+	"location_api_workq",
+	"connection_wq",
+	"fota_wq",
+	"idle",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(watched_threads) <= HEALTH_THREADS_MAX);
+
+#ifdef HEALTH_HEAP_FRAG
+static size_t heap_largest_block(void)
+{
+	struct z_heap *h = _system_heap.heap.heap;
+	k_spinlock_key_t key;
+	chunksz_t largest = 0;
+
+	/* Free chunks are binned by size in power of two buckets, so the
+	 * largest one is in the highest non-empty bucket. Read it without
+	 * allocating so the probe never makes other allocations fail.
+	 */
+	key = k_spin_lock(&_system_heap.lock);
+
+	if (h->avail_buckets) {
+		int b = 31 - __builtin_clz(h->avail_buckets);
+		chunkid_t first = h->buckets[b].next;
+		chunkid_t c = first;
+
+		for (int i = 0; i < HEAP_BUCKET_WALK_MAX; i++) {
+			largest = MAX(largest, chunk_size(h, c));
+			c = next_free_chunk(h, c);
+			if (c == first) {
+				break;
+			}
+		}
+	}
+
+	k_spin_unlock(&_system_heap.lock, key);
+
+	if (largest == 0) {
+		return 0;
+	}
+	return chunksz_to_bytes(h, largest) - chunk_header_bytes(h);
+}
+#endif
+
+static void thread_cb(const struct k_thread *cthread, void *user_data)
+{
+	struct health_stats *stats = user_data;
+	struct k_thread *thread = (struct k_thread *)cthread;
+	const char *name = k_thread_name_get(thread);
+	struct health_thread *t;
+	size_t unused;
+
+	if (k_thread_stack_space_get(thread, &unused)) {
+		return;
+	}
+
+	if (unused < HEALTH_STACK_UNUSED_MIN) {
+		stats->alerts |= HEALTH_ALERT_STACK;
+	}
+
+	for (size_t i = 0; name && i < ARRAY_SIZE(watched_threads); i++) {
+		if (strcmp(name, watched_threads[i]) == 0) {
+			/* Slot by table index, compacted after the walk */
+			t = &stats->threads[i];
+			t->name = watched_threads[i];
+			t->size = thread->stack_info.size;
+			t->unused = unused;
+			break;
+		}
+	}
+}
+
+int health_mod_init(void)
+{
+	k_timer_start(&probe_timer, HEALTH_PROBE_PERIOD, HEALTH_PROBE_PERIOD);
+
+	return 0;
+}
+
+uint32_t health_mod_sample(struct health_stats *stats)
+{
+	struct sys_memory_stats heap;
+	uint32_t raised;
+	__maybe_unused size_t largest;
+	int err;
+
+	memset(stats, 0, sizeof(*stats));
+
+	err = sys_heap_runtime_stats_get(&_system_heap.heap, &heap);
+	if (err == 0) {
+		stats->heap_free = heap.free_bytes;
+		stats->heap_max_used = heap.max_allocated_bytes;
+
+#ifdef HEALTH_HEAP_FRAG
+		largest = MIN(heap_largest_block(), heap.free_bytes);
+		stats->heap_frag = heap.free_bytes ?
+			100 - (largest * 100) / heap.free_bytes : 0;
+#endif
+
+		if (stats->heap_free < HEALTH_HEAP_FREE_MIN ||
+		    stats->heap_frag > HEALTH_HEAP_FRAG_MAX) {
+			stats->alerts |= HEALTH_ALERT_HEAP;
+		}
+	}
+
+	/* Stack scans are slow, keep interrupts enabled while walking */
+	k_thread_foreach_unlocked(thread_cb, stats);
+
+	for (size_t i = 0; i < ARRAY_SIZE(watched_threads); i++) {
+		if (stats->threads[i].name) {
+			stats->threads[stats->threads_len++] = stats->threads[i];
+		}
+	}
+
+	stats->wq_latency_us = atomic_get(&wq_latency_us);
+	stats->wq_latency_max_us = atomic_get(&wq_latency_max_us);
+	if (stats->wq_latency_us > HEALTH_WQ_LATENCY_MAX_US) {
+		stats->alerts |= HEALTH_ALERT_WQ;
+	}
+
+	raised = stats->alerts & ~last_alerts;
+	last_alerts = stats->alerts;
+
+	if (raised) {
+		LOG_WRN("Health alert 0x%x: heap free %d frag %d%%, wq %d us",
+			raised, stats->heap_free, stats->heap_frag, stats->wq_latency_us);
+	}
+
+	return raised;
+}
@@ -0,0 +1,48 @@
+#ifndef HEALTH_MODULE_H__
+#define HEALTH_MODULE_H__
+
+#include <zephyr/kernel.h>
+
+/* Threads reported in the shadow, picked by name in health_module.c. */
+#define HEALTH_THREADS_MAX		8
+
+/* Alert thresholds */
+#define HEALTH_HEAP_FREE_MIN		4096	/* bytes */
+#define HEALTH_HEAP_FRAG_MAX		50	/* percent */
+#define HEALTH_STACK_UNUSED_MIN		256	/* bytes */
+#define HEALTH_WQ_LATENCY_MAX_US	100000
+
+/* Bits set in health_stats.alerts */
+#define HEALTH_ALERT_HEAP		BIT(0)
+#define HEALTH_ALERT_STACK		BIT(1)
+#define HEALTH_ALERT_WQ			BIT(2)
+
+struct health_thread {
+	const char *name;
+	uint32_t size;
+	uint32_t unused;	/* Stack never touched since boot */
+};
+
+struct health_stats {
+	uint32_t heap_free;
+	uint32_t heap_max_used;	/* High-water mark since boot */
+	uint32_t heap_frag;	/* Percent of free space not in the largest block,
+				 * 0 without HEALTH_HEAP_FRAG
+				 */
+	uint32_t wq_latency_us;	/* Last system work queue probe */
+	uint32_t wq_latency_max_us;
+	uint32_t alerts;
+	struct health_thread threads[HEALTH_THREADS_MAX];
+	size_t threads_len;
+};
+
+int health_mod_init(void);
+
+/**
+ * Take a sample of heap, stack and work queue health.
+ *
+ * @return Alert bits that were not set in the previous sample.
+ */
+uint32_t health_mod_sample(struct health_stats *stats);
+
+#endif
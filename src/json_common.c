@@ -4,6 +4,78 @@
 
 LOG_MODULE_REGISTER(json_common);
 
+static const struct json_obj_descr config_descr[] = {
+	JSON_OBJ_DESCR_PRIM_NAMED(struct app_config, "fix_interval",
+				  fix_interval, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct app_config, "gnss_timeout",
+				  gnss_timeout, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct app_config, "cell_timeout",
+				  cell_timeout, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct app_config, "ping_period",
+				  ping_period, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct app_config, "agnss_mask",
+				  agnss_mask, JSON_TOK_NUMBER),
+};
+
+static const struct json_obj_descr geofence_descr[] = {
+	JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_desc, "id",
+				  id, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_desc, "radius",
+				  radius, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_ARRAY_NAMED(struct geofence_desc, "pts", pts,
+				   2 * GEOFENCE_POLY_VERTICES_MAX, pts_len,
+				   JSON_TOK_NUMBER),
+};
+
+static const struct json_obj_descr conn_descr[] = {
+	JSON_OBJ_DESCR_PRIM_NAMED(struct connection_stats, "count",
+				  count, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct connection_stats, "resumed",
+				  resumed, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct connection_stats, "connect_ms",
+				  connect_ms, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct connection_stats, "outage_ms",
+				  outage_ms, JSON_TOK_NUMBER),
+};
+
+static const struct json_obj_descr thread_descr[] = {
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_thread, "name",
+				  name, JSON_TOK_STRING),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_thread, "size",
+				  size, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_thread, "unused",
+				  unused, JSON_TOK_NUMBER),
+};
+
+static const struct json_obj_descr health_descr[] = {
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_stats, "heap_free",
+				  heap_free, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_stats, "heap_max_used",
+				  heap_max_used, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_stats, "heap_frag",
+				  heap_frag, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_stats, "wq_us",
+				  wq_latency_us, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_stats, "wq_max_us",
+				  wq_latency_max_us, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct health_stats, "alerts",
+				  alerts, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_OBJ_ARRAY_NAMED(struct health_stats, "threads", threads,
+				       HEALTH_THREADS_MAX, threads_len,
+				       thread_descr, ARRAY_SIZE(thread_descr)),
+};
+
+static const struct json_obj_descr fota_descr[] = {
+	JSON_OBJ_DESCR_PRIM_NAMED(struct fota_status, "state",
+				  state, JSON_TOK_STRING),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct fota_status, "progress",
+				  progress, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct fota_status, "err",
+				  err, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM_NAMED(struct fota_status, "version",
+				  version, JSON_TOK_STRING),
+};
+
 int json_shadow_construct(char *message, size_t size, struct shadow *payload)
 {
 	int err;
@@ -18,6 +90,14 @@ int json_shadow_construct(char *message, size_t size, struct shadow *payload)
 					  state.reported.tac, JSON_TOK_NUMBER),					  
 		JSON_OBJ_DESCR_PRIM_NAMED(struct shadow, "eci",
 					  state.reported.eci, JSON_TOK_NUMBER),	
+		JSON_OBJ_DESCR_OBJECT_NAMED(struct shadow, "config",
+					    state.reported.config, config_descr),
+		JSON_OBJ_DESCR_OBJECT_NAMED(struct shadow, "conn",
+					    state.reported.conn, conn_descr),
+		JSON_OBJ_DESCR_OBJECT_NAMED(struct shadow, "health",
+					    state.reported.health, health_descr),
+		JSON_OBJ_DESCR_OBJECT_NAMED(struct shadow, "fota",
+					    state.reported.fota, fota_descr),
 	};
 	const struct json_obj_descr reported[] = {
 		JSON_OBJ_DESCR_OBJECT_NAMED(struct shadow, "reported", state.reported,
@@ -51,7 +131,248 @@ int json_agnss_req_construct(char *message, size_t size, struct agnss_request *p
 		JSON_OBJ_DESCR_PRIM_NAMED(struct agnss_request, "rsrp",
 					  rsrp, JSON_TOK_NUMBER),
 		JSON_OBJ_DESCR_PRIM_NAMED(struct agnss_request, "filtered",
-					  rsrp, JSON_TOK_TRUE),
+					  filtered, JSON_TOK_TRUE),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct agnss_request, "mask",
+					  mask, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct agnss_request, "chunk_size",
+					  chunk_size, JSON_TOK_NUMBER),
+	};
+
+	err = json_obj_encode_buf(root, ARRAY_SIZE(root), payload, message, size);
+	if (err) {
+		LOG_ERR("json_obj_encode_buf, error: %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+/* Desired config lives under "config", the same place it is reported, so
+ * applying and reporting a value clears its delta.
+ */
+struct config_state {
+	struct app_config config;
+};
+
+static const struct json_obj_descr config_state_descr[] = {
+	JSON_OBJ_DESCR_OBJECT(struct config_state, config, config_descr),
+};
+
+struct config_delta {
+	struct config_state state;
+};
+
+int json_config_delta_parse(char *message, size_t len, struct app_config *config)
+{
+	int ret;
+	struct config_delta delta = {
+		.state.config = *config,
+	};
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_OBJECT(struct config_delta, state, config_state_descr),
+	};
+
+	/* Only keys present in the document are written, the rest keep
+	 * whatever the caller put in config.
+	 */
+	ret = json_obj_parse(message, len, root, ARRAY_SIZE(root), &delta);
+	if (ret < 0) {
+		LOG_ERR("json_obj_parse, error: %d", ret);
+		return ret;
+	}
+
+	*config = delta.state.config;
+
+	return 0;
+}
+
+struct config_shadow_state {
+	struct config_state delta;
+};
+
+struct config_shadow {
+	struct config_shadow_state state;
+};
+
+int json_config_shadow_parse(char *message, size_t len, struct app_config *config)
+{
+	int ret;
+	struct config_shadow shadow = {
+		.state.delta.config = *config,
+	};
+	const struct json_obj_descr state_descr[] = {
+		JSON_OBJ_DESCR_OBJECT(struct config_shadow_state, delta,
+				      config_state_descr),
+	};
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_OBJECT(struct config_shadow, state, state_descr),
+	};
+
+	/* Only state.delta.config is read, desired, reported and metadata are
+	 * skipped.
+	 */
+	ret = json_obj_parse(message, len, root, ARRAY_SIZE(root), &shadow);
+	if (ret < 0) {
+		LOG_ERR("json_obj_parse, error: %d", ret);
+		return ret;
+	}
+
+	*config = shadow.state.delta.config;
+
+	return 0;
+}
+
+int json_geofence_parse(char *message, size_t len, struct geofence_msg *msg)
+{
+	int ret;
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_msg, "clear",
+					  clear, JSON_TOK_TRUE),
+		JSON_OBJ_DESCR_OBJ_ARRAY_NAMED(struct geofence_msg, "fences",
+					       fences, GEOFENCE_MSG_MAX, fences_len,
+					       geofence_descr, ARRAY_SIZE(geofence_descr)),
+	};
+
+	memset(msg, 0, sizeof(*msg));
+
+	ret = json_obj_parse(message, len, root, ARRAY_SIZE(root), msg);
+	if (ret < 0) {
+		LOG_ERR("json_obj_parse, error: %d", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+int json_geofence_report_construct(char *message, size_t size, struct geofence_report *payload)
+{
+	int err;
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_report, "id",
+					  id, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_report, "event",
+					  event, JSON_TOK_STRING),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_report, "lat",
+					  lat, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_report, "lon",
+					  lon, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct geofence_report, "uptime",
+					  uptime, JSON_TOK_NUMBER),
+	};
+
+	err = json_obj_encode_buf(root, ARRAY_SIZE(root), payload, message, size);
+	if (err) {
+		LOG_ERR("json_obj_encode_buf, error: %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+int json_cell_location_req_construct(char *message, size_t size, struct cell_location_req *payload)
+{
+	int err;
+	const struct json_obj_descr ncell[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_ncell, "earfcn",
+					  earfcn, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_ncell, "pci",
+					  pci, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_ncell, "rsrp",
+					  rsrp, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_ncell, "rsrq",
+					  rsrq, JSON_TOK_NUMBER),
+	};
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "id",
+					  id, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "mcc",
+					  mcc, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "mnc",
+					  mnc, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "tac",
+					  tac, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "eci",
+					  eci, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "earfcn",
+					  earfcn, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "pci",
+					  pci, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "rsrp",
+					  rsrp, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "rsrq",
+					  rsrq, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_req, "adv",
+					  adv, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_OBJ_ARRAY_NAMED(struct cell_location_req, "nmr", nmr,
+					       CELL_LOCATION_NCELLS_MAX, nmr_len,
+					       ncell, ARRAY_SIZE(ncell)),
+	};
+
+	err = json_obj_encode_buf(root, ARRAY_SIZE(root), payload, message, size);
+	if (err) {
+		LOG_ERR("json_obj_encode_buf, error: %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+int json_cell_location_res_parse(char *message, size_t len, struct cell_location_res *res)
+{
+	int ret;
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_res, "id",
+					  id, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_res, "lat",
+					  lat, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_res, "lon",
+					  lon, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_res, "acc",
+					  acc, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct cell_location_res, "err",
+					  err, JSON_TOK_NUMBER),
+	};
+
+	ret = json_obj_parse(message, len, root, ARRAY_SIZE(root), res);
+	if (ret < 0) {
+		LOG_ERR("json_obj_parse, error: %d", ret);
+	}
+
+	return ret;
+}
+
+int json_fota_job_parse(char *message, size_t len, struct fota_job *job)
+{
+	int ret;
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct fota_job, "size",
+					  size, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct fota_job, "version",
+					  version, JSON_TOK_STRING),
+	};
+
+	ret = json_obj_parse(message, len, root, ARRAY_SIZE(root), job);
+	if (ret < 0) {
+		LOG_ERR("json_obj_parse, error: %d", ret);
+		return ret;
+	}
+
+	/* The size is mandatory. */
+	if (!(ret & BIT(0))) {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int json_fota_chunk_request_construct(char *message, size_t size, struct fota_chunk_request *payload)
+{
+	int err;
+	const struct json_obj_descr root[] = {
+		JSON_OBJ_DESCR_PRIM_NAMED(struct fota_chunk_request, "offset",
+					  offset, JSON_TOK_NUMBER),
+		JSON_OBJ_DESCR_PRIM_NAMED(struct fota_chunk_request, "size",
+					  size, JSON_TOK_NUMBER),
 	};
 
 	err = json_obj_encode_buf(root, ARRAY_SIZE(root), payload, message, size);
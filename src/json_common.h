@@ -3,6 +3,13 @@
 
 #include <zephyr/data/json.h>
 
+#include "cell_location_module.h"
+#include "config_module.h"
+#include "connection_module.h"
+#include "fota_module.h"
+#include "geofence_module.h"
+#include "health_module.h"
+
 struct shadow {
 	struct {
 		struct {
@@ -11,6 +18,10 @@ struct shadow {
 			uint16_t mnc;
 			uint16_t tac;
 			double eci;
+			struct app_config config;
+			struct connection_stats conn;
+			struct health_stats health;
+			struct fota_status fota;
 		} reported;
 	} state;
 };
@@ -22,11 +33,92 @@ struct agnss_request {
 	double eci;
 	int rsrp;
 	bool filtered;
-	int mask;
+	int mask;		/* Required A-GNSS types, bit n-1 = type n */
+	int chunk_size;		/* Largest MQTT payload the device accepts */
+};
+
+struct geofence_desc {
+	int32_t id;
+	int32_t radius;
+	int32_t pts[2 * GEOFENCE_POLY_VERTICES_MAX];
+	size_t pts_len;
+};
+
+struct geofence_msg {
+	bool clear;
+	struct geofence_desc fences[GEOFENCE_MSG_MAX];
+	size_t fences_len;
+};
+
+struct geofence_report {
+	int32_t id;
+	const char *event;
+	int32_t lat;
+	int32_t lon;
+	uint32_t uptime;
+};
+
+struct cell_location_ncell {
+	int32_t earfcn;
+	int32_t pci;
+	int32_t rsrp;		/* Raw modem index, as reported by lte_lc */
+	int32_t rsrq;		/* Raw modem index, as reported by lte_lc */
+};
+
+struct cell_location_req {
+	int32_t id;
+	int32_t mcc;
+	int32_t mnc;
+	int32_t tac;
+	uint32_t eci;
+	int32_t earfcn;
+	int32_t pci;
+	int32_t rsrp;
+	int32_t rsrq;
+	int32_t adv;		/* Timing advance, 65535 when unknown */
+	struct cell_location_ncell nmr[CELL_LOCATION_NCELLS_MAX];
+	size_t nmr_len;
+};
+
+struct cell_location_res {
+	int32_t id;
+	int32_t lat;		/* microdegrees */
+	int32_t lon;		/* microdegrees */
+	int32_t acc;		/* metres */
+	int32_t err;
+};
+
+struct fota_job {
+	int32_t size;
+	char *version;
+};
+
+struct fota_chunk_request {
+	int32_t offset;
+	int32_t size;
 };
 
 int json_shadow_construct(char *message, size_t size, struct shadow *payload);
 
 int json_agnss_req_construct(char *message, size_t size, struct agnss_request *payload);
 
+/* Parse state.config of a shadow delta document. */
+int json_config_delta_parse(char *message, size_t len, struct app_config *config);
+
+/* Parse state.delta.config of a full shadow document, as sent on get/accepted. */
+int json_config_shadow_parse(char *message, size_t len, struct app_config *config);
+
+int json_geofence_parse(char *message, size_t len, struct geofence_msg *msg);
+
+int json_geofence_report_construct(char *message, size_t size, struct geofence_report *payload);
+
+int json_cell_location_req_construct(char *message, size_t size, struct cell_location_req *payload);
+
+int json_fota_job_parse(char *message, size_t len, struct fota_job *job);
+
+int json_fota_chunk_request_construct(char *message, size_t size, struct fota_chunk_request *payload);
+
+/* Returns the bitmask of fields found, in struct order, or a negative error. */
+int json_cell_location_res_parse(char *message, size_t len, struct cell_location_res *res);
+
 #endif
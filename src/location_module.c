@@ -1,12 +1,120 @@
 #include <modem/location.h>
+#include <net/nrf_cloud_agnss.h>
 #include <zephyr/logging/log.h>
 
 #include "location_module.h"
+#include "config_module.h"
+#include "cell_location_module.h"
+#include "geofence_module.h"
+#include "modem_module.h"
+#include "policy_module.h"
 
 LOG_MODULE_REGISTER(location_module);
 
 static K_SEM_DEFINE(location_event, 0, 1);
 
+/* A-GNSS types the modem last asked for, 0 until it has asked. */
+static atomic_t agnss_needed_mask;
+
+/* Method order of the request in flight, fed back to the policy when it
+ * completes. Only written by whoever set REQUEST_PENDING.
+ */
+static struct policy_decision decision;
+static int64_t request_start;
+
+#define REQUEST_PENDING 0
+static atomic_t request_flags;
+
+static bool periodic_enabled;
+
+static void periodic_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(periodic_work, periodic_work_fn);
+
+static void request_done(const struct location_event_data *event_data)
+{
+	bool gnss_tried = decision.gnss_first;
+	bool gnss_ok = event_data->id == LOCATION_EVT_LOCATION &&
+		       event_data->method == LOCATION_METHOD_GNSS;
+	struct app_config app_cfg;
+
+	/* Any answer still on its way has nobody waiting for it */
+	cell_location_mod_cancel();
+
+	if (!atomic_test_and_clear_bit(&request_flags, REQUEST_PENDING)) {
+		return;
+	}
+
+	/* Cellular first only tells us about GNSS if it fell back to it. */
+	if (gnss_tried || gnss_ok) {
+		policy_mod_record(&decision, gnss_ok, k_uptime_get() - request_start);
+	}
+
+	if (periodic_enabled) {
+		config_mod_get(&app_cfg);
+		k_work_reschedule(&periodic_work, K_SECONDS(app_cfg.fix_interval));
+	}
+}
+
+static int request_start_with_policy(void)
+{
+	int err;
+	struct location_config config;
+	struct app_config app_cfg;
+	enum location_method methods[] = {LOCATION_METHOD_GNSS, LOCATION_METHOD_CELLULAR};
+	int gnss = 0;
+	int cellular = 1;
+
+	/* Leave the request in flight and its decision alone. Taken before
+	 * deciding, which updates the policy table and may evict the context
+	 * the request in flight records into.
+	 */
+	if (atomic_test_and_set_bit(&request_flags, REQUEST_PENDING)) {
+		return -EBUSY;
+	}
+
+	config_mod_get(&app_cfg);
+	policy_mod_decide(modem_mod_cell_id_get(), app_cfg.gnss_timeout, &decision);
+
+	if (!decision.gnss_first) {
+		methods[0] = LOCATION_METHOD_CELLULAR;
+		methods[1] = LOCATION_METHOD_GNSS;
+		gnss = 1;
+		cellular = 0;
+	}
+
+	location_config_defaults_set(&config, ARRAY_SIZE(methods), methods);
+	config.methods[gnss].gnss.timeout = decision.gnss_timeout_ms;
+	config.methods[cellular].cellular.timeout = app_cfg.cell_timeout * MSEC_PER_SEC;
+
+	/* Set before the request starts, its events can arrive right away */
+	request_start = k_uptime_get();
+
+	err = location_request(&config);
+	if (err) {
+		atomic_clear_bit(&request_flags, REQUEST_PENDING);
+	}
+
+	return err;
+}
+
+static void periodic_work_fn(struct k_work *work)
+{
+	int err;
+
+	err = request_start_with_policy();
+	if (err == -EBUSY) {
+		/* Rescheduled when the request in flight completes */
+		return;
+	} else if (err) {
+		struct app_config app_cfg;
+
+		printk("Requesting location failed, error: %d\n", err);
+		config_mod_get(&app_cfg);
+		k_work_reschedule(&periodic_work, K_SECONDS(app_cfg.fix_interval));
+	}
+}
+
 int location_mod_init(void)
 {
     int err;
@@ -43,19 +151,46 @@ void location_event_handler(const struct location_event_data *event_data)
 		}
 		printk("  Google maps URL: https://maps.google.com/?q=%.06f,%.06f\n\n",
 			event_data->location.latitude, event_data->location.longitude);
+
+		geofence_mod_evaluate(event_data->location.latitude,
+				      event_data->location.longitude,
+				      event_data->location.accuracy);
+		request_done(event_data);
 		break;
 
 	case LOCATION_EVT_TIMEOUT:
 		printk("Getting location timed out\n\n");
+		request_done(event_data);
 		break;
 
 	case LOCATION_EVT_ERROR:
 		printk("Getting location failed\n\n");
+		request_done(event_data);
 		break;
 
-	case LOCATION_EVT_GNSS_ASSISTANCE_REQUEST:
-		printk("Getting location assistance requested (A-GNSS). Not doing anything.\n\n");
+	case LOCATION_EVT_GNSS_ASSISTANCE_REQUEST: {
+		enum nrf_cloud_agnss_type types[16];
+		int count;
+		int mask = 0;
+
+		count = nrf_cloud_agnss_type_array_get(&event_data->agnss_request,
+						       types, ARRAY_SIZE(types));
+		for (int i = 0; i < count; i++) {
+			if (types[i] >= 1 && types[i] <= 13) {
+				mask |= BIT(types[i] - 1);
+			}
+		}
+
+		printk("Getting location assistance requested (A-GNSS), types 0x%x.\n\n", mask);
+		atomic_set(&agnss_needed_mask, mask);
 		break;
+	}
+
+	case LOCATION_EVT_CLOUD_LOCATION_EXT_REQUEST:
+		printk("Getting cellular location from the cloud\n\n");
+		cell_location_mod_request(&event_data->cloud_location_request);
+		/* Not the end of the request, the result comes as another event. */
+		return;
 
 	case LOCATION_EVT_GNSS_PREDICTION_REQUEST:
 		printk("Getting location assistance requested (P-GPS). Not doing anything.\n\n");
@@ -72,18 +207,10 @@ void location_event_handler(const struct location_event_data *event_data)
 int location_with_fallback_get(void)
 {
 	int err;
-	struct location_config config;
-	enum location_method methods[] = {LOCATION_METHOD_GNSS, LOCATION_METHOD_CELLULAR};
 
-	location_config_defaults_set(&config, ARRAY_SIZE(methods), methods);
-	/* GNSS timeout is set to 1 second to force a failure. */
-	config.methods[0].gnss.timeout = 100 * MSEC_PER_SEC;
-	/* Default cellular configuration may be overridden here. */
-	config.methods[1].cellular.timeout = 40 * MSEC_PER_SEC;
-
-	LOG_INF("Requesting location with long GNSS timeout with fallback to cellular...\n");
+	LOG_INF("Requesting location with GNSS and cellular, order chosen by policy...\n");
 
-	err = location_request(&config);
+	err = request_start_with_policy();
 	if (err) {
 		return err;
 	}
@@ -95,18 +222,49 @@ int location_with_fallback_get(void)
 
 void location_gnss_periodic_get(void)
 {
-	int err;
-	struct location_config config;
-	enum location_method methods[] = {LOCATION_METHOD_GNSS, LOCATION_METHOD_CELLULAR};
+	struct app_config app_cfg;
 
-	location_config_defaults_set(&config, ARRAY_SIZE(methods), methods);
-	config.interval = 30;
+	config_mod_get(&app_cfg);
 
-	printk("Requesting 30s periodic GNSS location with cellular fallback...\n");
+	/* Single requests rather than the library's periodic mode, so every
+	 * fix gets its own method order and timeout.
+	 */
+	printk("Requesting %ds periodic location, GNSS and cellular...\n",
+		app_cfg.fix_interval);
 
-	err = location_request(&config);
-	if (err) {
-		printk("Requesting location failed, error: %d\n", err);
+	periodic_enabled = true;
+
+	/* Otherwise request_done() schedules the first periodic request */
+	if (!atomic_test_bit(&request_flags, REQUEST_PENDING)) {
+		k_work_reschedule(&periodic_work, K_NO_WAIT);
+	}
+}
+
+int location_mod_agnss_mask_get(void)
+{
+	return atomic_get(&agnss_needed_mask);
+}
+
+void location_mod_config_apply(int changed)
+{
+	int err;
+
+	if (!(changed & (APP_CONFIG_FIX_INTERVAL | APP_CONFIG_GNSS_TIMEOUT |
+			 APP_CONFIG_CELL_TIMEOUT))) {
 		return;
 	}
+
+	/* Timeouts apply from the next request, restart so the new interval
+	 * takes effect now.
+	 */
+	if (atomic_test_bit(&request_flags, REQUEST_PENDING)) {
+		err = location_request_cancel();
+		if (err) {
+			LOG_ERR("location_request_cancel, error: %d", err);
+		}
+		cell_location_mod_cancel();
+		atomic_clear_bit(&request_flags, REQUEST_PENDING);
+	}
+
+	location_gnss_periodic_get();
 }
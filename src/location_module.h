@@ -12,4 +12,10 @@ int location_with_fallback_get(void);
 
 void location_gnss_periodic_get(void);
 
+/* A-GNSS types the modem requested (bit n-1 = type n), 0 if unknown. */
+int location_mod_agnss_mask_get(void);
+
+/* Restart periodic location if any APP_CONFIG_* bit in changed affects it. */
+void location_mod_config_apply(int changed);
+
 #endif
@@ -12,6 +12,12 @@
 #include <modem/modem_info.h>
 #include <zephyr/drivers/gpio.h>
 
+#include "cell_location_module.h"
+#include "config_module.h"
+#include "fota_module.h"
+#include "connection_module.h"
+#include "geofence_module.h"
+#include "health_module.h"
 #include "json_common.h"
 #include "location_module.h"
 #include "modem_module.h"
@@ -60,20 +66,54 @@ static const struct device *gpio_dev;
 #define AGNSS_RESPONSE_TOPIC "nrfcloud/agps"
 #define AGNSS_RESPONSE_TOPIC_LEN 1
 
+#define GEOFENCE_EVENT_TOPIC "geofence/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/events"
+#define GEOFENCE_EVENT_TOPIC_IDX 1
+
+#define GEOFENCE_SET_TOPIC "geofence/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/set"
+
+#define CELL_LOCATION_REQUEST_TOPIC "location/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/req"
+#define CELL_LOCATION_REQUEST_TOPIC_IDX 2
+
+#define CELL_LOCATION_RESPONSE_TOPIC "location/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/res"
+
+#define FOTA_GET_TOPIC "fota/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/get"
+#define FOTA_GET_TOPIC_IDX 3
+
+#define FOTA_JOB_TOPIC "fota/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/job"
+#define FOTA_DATA_TOPIC "fota/" CONFIG_AWS_IOT_CLIENT_ID_STATIC "/data"
+
 static struct aws_iot_config config;
 static char client_id_buf[AWS_CLOUD_CLIENT_ID_LEN + 1];
 
-static struct aws_iot_topic_data pub_topics[1] = {
+static struct aws_iot_topic_data pub_topics[4] = {
         [AGNSS_REQUEST_TOPIC_IDX].str = AGNSS_REQUEST_TOPIC,
         [AGNSS_REQUEST_TOPIC_IDX].len = strlen(AGNSS_REQUEST_TOPIC),
+        [GEOFENCE_EVENT_TOPIC_IDX].str = GEOFENCE_EVENT_TOPIC,
+        [GEOFENCE_EVENT_TOPIC_IDX].len = strlen(GEOFENCE_EVENT_TOPIC),
+        [CELL_LOCATION_REQUEST_TOPIC_IDX].str = CELL_LOCATION_REQUEST_TOPIC,
+        [CELL_LOCATION_REQUEST_TOPIC_IDX].len = strlen(CELL_LOCATION_REQUEST_TOPIC),
+        [FOTA_GET_TOPIC_IDX].str = FOTA_GET_TOPIC,
+        [FOTA_GET_TOPIC_IDX].len = strlen(FOTA_GET_TOPIC),
 };
 
 const struct aws_iot_topic_data sub_topics[CONFIG_AWS_IOT_APP_SUBSCRIPTION_LIST_COUNT] = {
         [0].str = AGNSS_RESPONSE_TOPIC,
         [0].len = strlen(AGNSS_RESPONSE_TOPIC),
+        [1].str = GEOFENCE_SET_TOPIC,
+        [1].len = strlen(GEOFENCE_SET_TOPIC),
+        [2].str = CELL_LOCATION_RESPONSE_TOPIC,
+        [2].len = strlen(CELL_LOCATION_RESPONSE_TOPIC),
+        [3].str = FOTA_JOB_TOPIC,
+        [3].len = strlen(FOTA_JOB_TOPIC),
+        [4].str = FOTA_DATA_TOPIC,
+        [4].len = strlen(FOTA_DATA_TOPIC),
 };
 
 K_SEM_DEFINE(aws_connected, 0, 1);
+
+/* Wakes the main loop to apply config changes and report the shadow. */
+static K_SEM_DEFINE(shadow_update, 0, 1);
+static atomic_t config_changed_mask;
 //////////////////////////////////////////////////////////////////////////////
 
 static void print_hex(const char* buf, const size_t len) {
@@ -87,6 +127,8 @@ static void aws_iot_event_handler(const struct aws_iot_evt *const evt)
 {
     int err;
 
+	connection_mod_aws_evt(evt);
+
 	switch (evt->type) {
 		case AWS_IOT_EVT_CONNECTING:
 			LOG_INF("Connecting to AWS");
@@ -101,6 +143,7 @@ static void aws_iot_event_handler(const struct aws_iot_evt *const evt)
 		case AWS_IOT_EVT_READY:
 			LOG_INF("AWS Ready");
 			k_sem_give(&aws_connected);
+			geofence_mod_flush();
 			break;
 		case AWS_IOT_EVT_DATA_RECEIVED:
 			LOG_INF("AWS_IOT_EVT_DATA_RECEIVED");
@@ -110,15 +153,55 @@ static void aws_iot_event_handler(const struct aws_iot_evt *const evt)
 									evt->data.msg.topic.len,
 									evt->data.msg.topic.str);
 			//print_hex(evt->data.msg.ptr, evt->data.msg.len);
-			if (strncmp(evt->data.msg.topic.str, AGNSS_RESPONSE_TOPIC, evt->data.msg.topic.len) == 0) {
+			if (evt->data.msg.topic.type == AWS_IOT_SHADOW_TOPIC_UPDATE_DELTA) {
+				err = config_mod_delta_process(evt->data.msg.ptr, evt->data.msg.len);
+				if (err < 0) {
+					LOG_ERR("Unable to process shadow delta, error: %d", err);
+					break;
+				}
+				/* Report back even when nothing changed so the delta clears. */
+				atomic_or(&config_changed_mask, err);
+				k_sem_give(&shadow_update);
+			} else if (evt->data.msg.topic.type == AWS_IOT_SHADOW_TOPIC_GET_ACCEPTED) {
+				/* Requested on every connect, carries the delta built
+				 * up while offline.
+				 */
+				err = config_mod_shadow_process(evt->data.msg.ptr, evt->data.msg.len);
+				if (err < 0) {
+					LOG_ERR("Unable to process shadow, error: %d", err);
+					break;
+				}
+				atomic_or(&config_changed_mask, err);
+				k_sem_give(&shadow_update);
+			} else if (strncmp(evt->data.msg.topic.str, AGNSS_RESPONSE_TOPIC, evt->data.msg.topic.len) == 0) {
 				err = nrf_cloud_agnss_process(evt->data.msg.ptr, evt->data.msg.len);
 				if (err) {
 					LOG_ERR("Unable to process A-GNSS data, error: %d", err);
 				}
+			} else if (strncmp(evt->data.msg.topic.str, GEOFENCE_SET_TOPIC, evt->data.msg.topic.len) == 0) {
+				err = geofence_mod_load(evt->data.msg.ptr, evt->data.msg.len);
+				if (err < 0) {
+					LOG_ERR("Unable to load geofences, error: %d", err);
+				}
+			} else if (strncmp(evt->data.msg.topic.str, CELL_LOCATION_RESPONSE_TOPIC, evt->data.msg.topic.len) == 0) {
+				err = cell_location_mod_response(evt->data.msg.ptr, evt->data.msg.len);
+				if (err < 0) {
+					LOG_ERR("Unable to process cell location, error: %d", err);
+				}
+			} else if (strncmp(evt->data.msg.topic.str, FOTA_JOB_TOPIC, evt->data.msg.topic.len) == 0) {
+				err = fota_mod_job(evt->data.msg.ptr, evt->data.msg.len);
+				if (err) {
+					LOG_ERR("Unable to start FOTA, error: %d", err);
+				}
+			} else if (strncmp(evt->data.msg.topic.str, FOTA_DATA_TOPIC, evt->data.msg.topic.len) == 0) {
+				err = fota_mod_data(evt->data.msg.ptr, evt->data.msg.len);
+				if (err) {
+					LOG_WRN("FOTA chunk dropped, error: %d", err);
+				}
 			}
 			break;
 		case AWS_IOT_EVT_DISCONNECTED:
-			LOG_INF("AWS Disconnected");
+			LOG_INF("AWS Disconnected, reconnecting");
 			break;
 		case AWS_IOT_EVT_ERROR:
 			LOG_ERR("AWS Err");
@@ -154,6 +237,11 @@ static int update_aws_shadow() {
 		.state.reported.eci = modem_info.network.cellid_dec,
 	};
 
+	config_mod_get(&payload.state.reported.config);
+	connection_mod_stats_get(&payload.state.reported.conn);
+	health_mod_sample(&payload.state.reported.health);
+	fota_mod_status_get(&payload.state.reported.fota);
+
 	err = json_shadow_construct(buf, sizeof(buf), &payload);
 	if (err) {
 		LOG_ERR("json_shadow_construct, error: %d", err);
@@ -197,6 +285,16 @@ static int aws_agnss_req() {
 
 	char buf[4096];
 	bool ack = false;
+	struct app_config app_cfg;
+	int mask;
+
+	config_mod_get(&app_cfg);
+
+	/* Prefer what the modem actually asked for, limited to the configured types. */
+	mask = location_mod_agnss_mask_get() & app_cfg.agnss_mask;
+	if (mask == 0) {
+		mask = app_cfg.agnss_mask;
+	}
 
 	struct agnss_request payload = {
 		.mcc = modem_info.network.mcc.value,
@@ -205,7 +303,8 @@ static int aws_agnss_req() {
 		.eci = modem_info.network.cellid_dec,
 		.rsrp = modem_info.network.rsrp.value,
 		.filtered = true,
-		.mask = 5,
+		.mask = mask,
+		.chunk_size = CONFIG_AWS_IOT_MQTT_PAYLOAD_BUFFER_LEN,
 	};
 
 	err = json_agnss_req_construct(buf, sizeof(buf), &payload);
@@ -234,6 +333,78 @@ static int aws_agnss_req() {
 	return 0;
 }
 
+static int geofence_event_handler(const struct geofence_event *evt)
+{
+	int err;
+	char buf[128];
+
+	struct geofence_report payload = {
+		.id = evt->id,
+		.event = evt->transition == GEOFENCE_ENTER ? "enter" : "exit",
+		.lat = evt->lat,
+		.lon = evt->lon,
+		.uptime = k_uptime_get(),
+	};
+
+	err = json_geofence_report_construct(buf, sizeof(buf), &payload);
+	if (err) {
+		LOG_ERR("json_geofence_report_construct, error: %d", err);
+		/* Cannot get better by retrying */
+		return 0;
+	}
+
+	/* Transitions are rare and the backend relies on them, so ask for an ack. */
+	struct aws_iot_data msg = {
+		.ptr = buf,
+		.len = strlen(buf),
+		.message_id = aws_iot_message_id_get(),
+		.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+		.topic = pub_topics[GEOFENCE_EVENT_TOPIC_IDX],
+	};
+
+	LOG_INF("Publishing message: %s to %s", buf, GEOFENCE_EVENT_TOPIC);
+
+	err = aws_iot_send(&msg);
+	if (err) {
+		LOG_ERR("aws_iot_send, error: %d", err);
+	}
+
+	return err;
+}
+
+static int cell_location_publish(const char *buf, size_t len)
+{
+	struct aws_iot_data msg = {
+		.ptr = (char *)buf,
+		.len = len,
+		.message_id = aws_iot_message_id_get(),
+		.qos = MQTT_QOS_0_AT_MOST_ONCE,
+		.topic = pub_topics[CELL_LOCATION_REQUEST_TOPIC_IDX],
+	};
+
+	LOG_INF("Publishing message: %s to %s", buf, CELL_LOCATION_REQUEST_TOPIC);
+
+	return aws_iot_send(&msg);
+}
+
+static int fota_publish(const char *buf, size_t len)
+{
+	struct aws_iot_data msg = {
+		.ptr = (char *)buf,
+		.len = len,
+		.message_id = aws_iot_message_id_get(),
+		.qos = MQTT_QOS_0_AT_MOST_ONCE,
+		.topic = pub_topics[FOTA_GET_TOPIC_IDX],
+	};
+
+	return aws_iot_send(&msg);
+}
+
+static void fota_status_handler(void)
+{
+	k_sem_give(&shadow_update);
+}
+
 int gpio_init(void)
 {
 	int err;
@@ -270,6 +441,14 @@ int main(void)
 		return err;
 	}
 	
+	health_mod_init();
+
+	err = config_mod_init();
+	if (err) {
+		/* Defaults are still usable, carry on without persistence. */
+		LOG_ERR("Config initialization failed, err %d", err);
+	}
+
 	//////////////////////////////////////////////////////////////////////////
 	// Setup Modem and connect to LTE network
 
@@ -294,6 +473,14 @@ int main(void)
 	//////////////////////////////////////////////////////////////////////////
 	// Try to get initial location and then setup periodic location
 
+	geofence_mod_init(geofence_event_handler);
+	cell_location_mod_init(cell_location_publish);
+
+	err = fota_mod_init(fota_publish, fota_status_handler);
+	if (err) {
+		LOG_ERR("FOTA initialization failed, err %d", err);
+	}
+
 	err = location_mod_init();
 	if (err) {
 		LOG_ERR("location module init error: %d", err);
@@ -338,17 +525,17 @@ int main(void)
         return err;
 	}
 
-	err = aws_iot_connect(&config);
-	if (err) {
-		LOG_ERR("aws_iot_init, error: %d", err);
-		FATAL_ERROR();
-		return err;
-	}
+	/* Connection failures are retried with backoff by the connection module. */
+	connection_mod_init(&config, sub_topics, ARRAY_SIZE(sub_topics));
+	connection_mod_start();
 
 	LOG_INF("Waiting for AWS...");
 	k_sem_take(&aws_connected, K_FOREVER);
 	LOG_INF("Connected to AWS network!");
 
+	/* Reaching the cloud is the test a new image has to pass. */
+	fota_mod_confirm();
+
 	set_led(LED_OFF /* red */, LED_OFF /* green */, LED_ON /* blue */);
 
 	update_aws_shadow();
@@ -356,13 +543,30 @@ int main(void)
 	aws_agnss_req();
 
 	while (1 == 1) {
+		struct app_config app_cfg;
+		struct health_stats health;
+		int changed;
+
 		err = aws_iot_ping();
 		if (err) {
 			printf("aws_iot_ping, error: %d\n", err);
 		}
 		printf("waiting...\n");
 		
-		k_sleep(K_MSEC(10000));
+		config_mod_get(&app_cfg);
+		if (k_sem_take(&shadow_update, K_SECONDS(app_cfg.ping_period)) == 0) {
+			changed = atomic_clear(&config_changed_mask);
+			location_mod_config_apply(changed);
+			update_aws_shadow();
+
+			/* Fetch the newly enabled types now rather than at the next boot. */
+			if (changed & APP_CONFIG_AGNSS_MASK) {
+				aws_agnss_req();
+			}
+		} else if (health_mod_sample(&health)) {
+			/* Publish new alerts now, the shadow carries the details. */
+			update_aws_shadow();
+		}
 	}
 	
 	return 0;
@@ -10,6 +10,7 @@
 #include <zephyr/drivers/clock_control/nrf_clock_control.h>
 
 #include "modem_module.h"
+#include "connection_module.h"
 #include "certificates.h"
 
 LOG_MODULE_REGISTER(modem_module);
@@ -17,6 +18,8 @@ LOG_MODULE_REGISTER(modem_module);
 static K_SEM_DEFINE(lte_connected, 0, 1);
 static K_SEM_DEFINE(time_update_finished, 0, 1);
 
+static atomic_t serving_cell_id;
+
 
 void lte_handler(const struct lte_lc_evt *const evt)
 {
@@ -24,12 +27,15 @@ void lte_handler(const struct lte_lc_evt *const evt)
         case LTE_LC_EVT_NW_REG_STATUS:
                 if (evt->nw_reg_status != LTE_LC_NW_REG_REGISTERED_HOME &&
                     evt->nw_reg_status != LTE_LC_NW_REG_REGISTERED_ROAMING) {
+                        LOG_INF("Network registration lost, status %d", evt->nw_reg_status);
+                        connection_mod_lte_status(false);
                         break;
                 }
 
                 LOG_INF("Connected to: %s network\n",
                        evt->nw_reg_status == LTE_LC_NW_REG_REGISTERED_HOME ? "home" : "roaming");
 
+                connection_mod_lte_status(true);
                 k_sem_give(&lte_connected);
                 break;
 
@@ -41,6 +47,8 @@ void lte_handler(const struct lte_lc_evt *const evt)
 			LOG_INF("RRC mode: %s", evt->rrc_mode == LTE_LC_RRC_MODE_CONNECTED ? "Connected" : "Idle");
 			break;
         case LTE_LC_EVT_CELL_UPDATE:
+                atomic_set(&serving_cell_id, evt->cell.id);
+                break;
         case LTE_LC_EVT_LTE_MODE_UPDATE:
         case LTE_LC_EVT_TAU_PRE_WARNING:
         case LTE_LC_EVT_NEIGHBOR_CELL_MEAS:
@@ -152,6 +160,11 @@ int modem_mod_connect(void) {
     return 0;
 }
 
+uint32_t modem_mod_cell_id_get(void)
+{
+    return atomic_get(&serving_cell_id);
+}
+
 int network_info_log(void)
 {
     LOG_DBG("====== Cell Network Info ======");
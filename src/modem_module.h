@@ -7,4 +7,7 @@ int modem_mod_init(void);
 
 int modem_mod_connect(void);
 
+/* Serving cell ID from the last cell update, 0 before the first one. */
+uint32_t modem_mod_cell_id_get(void);
+
 #endif
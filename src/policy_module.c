@@ -0,0 +1,119 @@
+#include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+#include <date_time.h>
+
+#include "policy_module.h"
+
+LOG_MODULE_REGISTER(policy_module);
+
+/* Time of day is bucketed into 6 hour slots (UTC). */
+#define POLICY_HOUR_BUCKETS	4
+
+struct policy_ctx {
+	uint32_t cell_id;
+	uint8_t bucket;
+	uint8_t attempts;	/* Saturates, only gates the first decisions */
+	uint8_t gnss_rate;	/* Exponentially weighted success, percent */
+	uint32_t ttf_ms;	/* Exponentially weighted time to fix */
+	int64_t last_used;
+};
+
+static struct policy_ctx contexts[POLICY_CONTEXTS_MAX];
+
+static K_MUTEX_DEFINE(policy_lock);
+
+static uint8_t hour_bucket(void)
+{
+	int64_t now_ms;
+
+	if (date_time_now(&now_ms)) {
+		return 0;
+	}
+
+	return (now_ms / MSEC_PER_SEC / 3600) % 24 / (24 / POLICY_HOUR_BUCKETS);
+}
+
+static int ctx_find(uint32_t cell_id, uint8_t bucket)
+{
+	int oldest = 0;
+
+	for (int i = 0; i < POLICY_CONTEXTS_MAX; i++) {
+		if (contexts[i].last_used &&
+		    contexts[i].cell_id == cell_id && contexts[i].bucket == bucket) {
+			return i;
+		}
+		if (contexts[i].last_used < contexts[oldest].last_used) {
+			oldest = i;
+		}
+	}
+
+	/* New contexts start optimistic so GNSS gets tried first. */
+	contexts[oldest] = (struct policy_ctx){
+		.cell_id = cell_id,
+		.bucket = bucket,
+		.gnss_rate = 100,
+	};
+
+	return oldest;
+}
+
+void policy_mod_decide(uint32_t cell_id, uint32_t gnss_timeout_max_s,
+		       struct policy_decision *decision)
+{
+	struct policy_ctx *ctx;
+	uint32_t timeout_max_ms = gnss_timeout_max_s * MSEC_PER_SEC;
+
+	k_mutex_lock(&policy_lock, K_FOREVER);
+
+	decision->ctx = ctx_find(cell_id, hour_bucket());
+	ctx = &contexts[decision->ctx];
+	ctx->last_used = k_uptime_get() ?: 1;
+
+	decision->gnss_first = true;
+	decision->gnss_timeout_ms = timeout_max_ms;
+
+	if (ctx->attempts < POLICY_MIN_ATTEMPTS) {
+		goto out;
+	}
+
+	if (ctx->gnss_rate < POLICY_GNSS_RATE_MIN) {
+		/* Occasionally retry with the full timeout to refresh the stats. */
+		decision->gnss_first = sys_rand32_get() % 100 < POLICY_PROBE_PERCENT;
+		goto out;
+	}
+
+	/* GNSS works here, but a fix that has not come by twice the usual
+	 * time to fix is unlikely to come at all.
+	 */
+	decision->gnss_timeout_ms = CLAMP(2 * ctx->ttf_ms,
+					  POLICY_GNSS_TIMEOUT_MIN_S * MSEC_PER_SEC,
+					  timeout_max_ms);
+
+out:
+	LOG_INF("Cell %d bucket %d: GNSS rate %d%%, ttf %d ms -> %s first, timeout %d ms",
+		cell_id, ctx->bucket, ctx->gnss_rate, ctx->ttf_ms,
+		decision->gnss_first ? "GNSS" : "cellular", decision->gnss_timeout_ms);
+
+	k_mutex_unlock(&policy_lock);
+}
+
+void policy_mod_record(const struct policy_decision *decision, bool gnss_ok,
+		       uint32_t ttf_ms)
+{
+	struct policy_ctx *ctx;
+
+	k_mutex_lock(&policy_lock, K_FOREVER);
+
+	ctx = &contexts[decision->ctx];
+
+	/* Weight 1/4 for the newest sample. */
+	ctx->gnss_rate = (3 * ctx->gnss_rate + (gnss_ok ? 100 : 0)) / 4;
+	if (gnss_ok) {
+		ctx->ttf_ms = ctx->ttf_ms ? (3 * ctx->ttf_ms + ttf_ms) / 4 : ttf_ms;
+	}
+	if (ctx->attempts < UINT8_MAX) {
+		ctx->attempts++;
+	}
+
+	k_mutex_unlock(&policy_lock);
+}
@@ -0,0 +1,47 @@
+#ifndef POLICY_MODULE_H__
+#define POLICY_MODULE_H__
+
+#include <zephyr/kernel.h>
+
+/* Contexts (serving cell and time of day) remembered, least recently used
+ * is replaced first.
+ */
+#define POLICY_CONTEXTS_MAX		16
+
+/* GNSS is skipped once its success rate in a context drops below this,
+ * after at least POLICY_MIN_ATTEMPTS tries.
+ */
+#define POLICY_GNSS_RATE_MIN		30	/* percent */
+#define POLICY_MIN_ATTEMPTS		3
+
+/* Chance of trying GNSS anyway in a context where it is skipped, so a
+ * context that has become good again is noticed.
+ */
+#define POLICY_PROBE_PERCENT		10
+
+/* Lower bound for the learned GNSS timeout. */
+#define POLICY_GNSS_TIMEOUT_MIN_S	30
+
+struct policy_decision {
+	bool gnss_first;
+	uint32_t gnss_timeout_ms;
+	int ctx;		/* Internal, context the decision was made for */
+};
+
+/**
+ * Pick the method order and GNSS timeout for the next location request.
+ *
+ * @param cell_id Serving cell, 0 if unknown.
+ * @param gnss_timeout_max_s Configured GNSS timeout, never exceeded.
+ */
+void policy_mod_decide(uint32_t cell_id, uint32_t gnss_timeout_max_s,
+		       struct policy_decision *decision);
+
+/**
+ * Record how GNSS did for a request made with decision. Only call when GNSS
+ * was actually tried.
+ */
+void policy_mod_record(const struct policy_decision *decision, bool gnss_ok,
+		       uint32_t ttf_ms);
+
+#endif
@@ -0,0 +1,63 @@
+// Regenerate src/vectors.h: a source image, a target image made from it by
+// typical firmware edits, and the patch tools/fota_delta.mjs builds.
+//
+//   node gen_vectors.mjs
+import { writeFileSync } from 'node:fs';
+import { fileURLToPath } from 'node:url';
+
+import { diff, apply } from '../../tools/fota_delta.mjs';
+
+// Deterministic, so the header only changes with the tool
+let seed = 0x2545f491;
+function random_bytes(len) {
+    const out = Buffer.alloc(len);
+    for (let i = 0; i < len; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >>> 17;
+        seed ^= seed << 5;
+        out[i] = seed & 0xff;
+    }
+    return out;
+}
+
+const source = random_bytes(3072);
+const target = Buffer.concat([
+    source.subarray(0, 500),
+    random_bytes(20),                   // changed code
+    source.subarray(520, 1250),
+    random_bytes(201),                  // inserted function
+    source.subarray(2000, 2600),        // moved block
+    source.subarray(1250, 2000),
+    Buffer.from('v1.1.0\0'),            // new version string
+    source.subarray(2700, 3072),
+]);
+
+const { patch } = diff(source, target);
+if (!apply(source, patch).equals(target)) {
+    throw new Error('patch does not rebuild the target');
+}
+
+function c_array(name, buf) {
+    const lines = [];
+    for (let i = 0; i < buf.length; i += 12) {
+        lines.push('\t' + [ ...buf.subarray(i, i + 12) ]
+            .map((b) => `0x${b.toString(16).padStart(2, '0')},`).join(' '));
+    }
+    return `static const uint8_t ${name}[] = {\n${lines.join('\n')}\n};\n`;
+}
+
+const header = `/* Generated by gen_vectors.mjs, do not edit. */
+
+#ifndef VECTORS_H__
+#define VECTORS_H__
+
+#include <stdint.h>
+
+${c_array('source_img', source)}
+${c_array('target_img', target)}
+${c_array('patch_bin', patch)}
+#endif
+`;
+
+writeFileSync(fileURLToPath(new URL('src/vectors.h', import.meta.url)), header);
+console.log(`source ${source.length}, target ${target.length}, patch ${patch.length} bytes`);
@@ -0,0 +1,152 @@
+#include <string.h>
+#include <zephyr/ztest.h>
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/storage/flash_map.h>
+
+#include "fota_patch.h"
+#include "vectors.h"
+
+#define SOURCE_AREA	FIXED_PARTITION_ID(slot0_partition)
+
+static const struct flash_area *source;
+static struct flash_img_context img_ctx;
+static struct fota_patch patch;
+
+static uint8_t patch_copy[sizeof(patch_bin)];
+static uint8_t readback[sizeof(target_img)];
+
+/* Feed len bytes in pieces of split bytes, split 0 picks varying sizes. */
+static int feed_split(const uint8_t *data, size_t len, size_t split)
+{
+	uint32_t state = 0x9e3779b9;
+	int err;
+
+	while (len) {
+		size_t n = split;
+
+		if (n == 0) {
+			state = state * 1664525 + 1013904223;
+			n = 1 + (state >> 24) % 97;
+		}
+		n = MIN(n, len);
+
+		err = fota_patch_feed(&patch, data, n);
+		if (err) {
+			return err;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void patch_start(void)
+{
+	zassert_ok(flash_img_init(&img_ctx));
+	fota_patch_init(&patch, source, &img_ctx);
+}
+
+static void *fota_patch_setup(void)
+{
+	zassert_ok(flash_area_open(SOURCE_AREA, &source));
+	zassert_ok(flash_area_erase(source, 0, source->fa_size));
+	zassert_ok(flash_area_write(source, 0, source_img, sizeof(source_img)));
+
+	return NULL;
+}
+
+static void fota_patch_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	memcpy(patch_copy, patch_bin, sizeof(patch_bin));
+}
+
+ZTEST(fota_patch, test_apply_odd_splits)
+{
+	const struct flash_area *target;
+	const size_t splits[] = { 1, 3, 7, 13, 75, 76, 77, 255, 256, 4096, 0 };
+
+	zassert_ok(flash_area_open(flash_img_get_upload_slot(), &target));
+
+	for (size_t i = 0; i < ARRAY_SIZE(splits); i++) {
+		patch_start();
+
+		zassert_ok(feed_split(patch_bin, sizeof(patch_bin), splits[i]),
+			   "feed failed with split %zu", splits[i]);
+		zassert_ok(fota_patch_finish(&patch),
+			   "finish failed with split %zu", splits[i]);
+
+		zassert_ok(flash_area_read(target, 0, readback, sizeof(readback)));
+		zassert_mem_equal(readback, target_img, sizeof(target_img),
+				  "wrong image with split %zu", splits[i]);
+	}
+
+	flash_area_close(target);
+}
+
+ZTEST(fota_patch, test_bad_source_hash)
+{
+	patch_copy[12] ^= 0x01;
+
+	patch_start();
+	zassert_equal(feed_split(patch_copy, sizeof(patch_copy), 7), -ENOEXEC);
+}
+
+ZTEST(fota_patch, test_bad_target_hash)
+{
+	int err;
+
+	patch_copy[44] ^= 0x01;
+
+	patch_start();
+	zassert_ok(feed_split(patch_copy, sizeof(patch_copy), 13));
+
+	err = fota_patch_finish(&patch);
+	zassert_not_equal(err, 0);
+	zassert_not_equal(err, -EBADMSG, "hash mismatch reported as malformed");
+}
+
+ZTEST(fota_patch, test_bad_magic)
+{
+	patch_copy[0] ^= 0x01;
+
+	patch_start();
+	zassert_equal(feed_split(patch_copy, sizeof(patch_copy), 0), -EBADMSG);
+}
+
+ZTEST(fota_patch, test_truncated)
+{
+	/* Cut inside the header, after it and near the end of the ops */
+	const size_t lens[] = { 40, FOTA_PATCH_HEADER_LEN, FOTA_PATCH_HEADER_LEN + 3,
+				sizeof(patch_bin) / 2, sizeof(patch_bin) - 10 };
+
+	for (size_t i = 0; i < ARRAY_SIZE(lens); i++) {
+		patch_start();
+		zassert_ok(feed_split(patch_bin, lens[i], 0));
+		zassert_equal(fota_patch_finish(&patch), -EBADMSG,
+			      "accepted %zu of %zu bytes", lens[i], sizeof(patch_bin));
+	}
+}
+
+ZTEST(fota_patch, test_missing_end)
+{
+	zassert_equal(patch_bin[sizeof(patch_bin) - 1], 0x00, "last op is not END");
+
+	patch_start();
+	zassert_ok(feed_split(patch_bin, sizeof(patch_bin) - 1, 0));
+	zassert_equal(fota_patch_finish(&patch), -EBADMSG);
+}
+
+ZTEST(fota_patch, test_data_after_end)
+{
+	const uint8_t extra = 0x00;
+
+	patch_start();
+	zassert_ok(feed_split(patch_bin, sizeof(patch_bin), 0));
+	zassert_equal(fota_patch_feed(&patch, &extra, 1), -EBADMSG);
+}
+
+ZTEST_SUITE(fota_patch, NULL, fota_patch_setup, fota_patch_before, NULL, NULL);
@@ -0,0 +1,569 @@
+/* Generated by gen_vectors.mjs, do not edit. */
+
+#ifndef VECTORS_H__
+#define VECTORS_H__
+
+#include <stdint.h>
+
+static const uint8_t source_img[] = {
+	0x3a, 0xab, 0xac, 0x26, 0xaf, 0x23, 0x1a, 0x71, 0x6c, 0x91, 0x5d, 0x31,
+	0x18, 0x3e, 0xbc, 0xd2, 0xef, 0x51, 0x22, 0x9d, 0x72, 0x4f, 0xdb, 0xd9,
+	0x6f, 0x39, 0x6e, 0xae, 0x2b, 0xc8, 0x22, 0x2f, 0x0c, 0xe3, 0xed, 0x8c,
+	0x68, 0x7b, 0xa2, 0x89, 0x99, 0xd6, 0x39, 0xa7, 0x9f, 0xf2, 0x55, 0xfe,
+	0x91, 0x15, 0xb8, 0x20, 0xaa, 0x7a, 0x94, 0x8a, 0xa0, 0x4d, 0xc0, 0x9d,
+	0xfe, 0x49, 0x4c, 0xdc, 0x8e, 0xe0, 0xb9, 0x06, 0xb2, 0x30, 0x29, 0x4a,
+	0x60, 0x1c, 0xdf, 0x3c, 0xb7, 0x62, 0xcf, 0x42, 0x05, 0x19, 0x0c, 0x4b,
+	0xb3, 0xdf, 0xe1, 0x7c, 0x45, 0xfb, 0x50, 0x51, 0x67, 0x70, 0x78, 0xc9,
+	0x04, 0xf8, 0x43, 0x0c, 0xb4, 0x48, 0x73, 0xcb, 0xc6, 0x05, 0xd8, 0x9f,
+	0x58, 0xf0, 0x6d, 0xd7, 0xe5, 0x38, 0xac, 0xee, 0xef, 0xed, 0xfc, 0xef,
+	0x97, 0xfe, 0x16, 0x37, 0xbc, 0x03, 0xe7, 0xaa, 0xb0, 0x65, 0x38, 0x43,
+	0x49, 0xd7, 0x59, 0x3b, 0xe0, 0x7f, 0x7f, 0xe2, 0xa3, 0xc9, 0xd6, 0xae,
+	0x2a, 0x67, 0x66, 0xed, 0xab, 0xb5, 0x4d, 0x73, 0xff, 0x96, 0x8a, 0x23,
+	0x32, 0x0b, 0x97, 0xef, 0x1c, 0x7d, 0xba, 0x41, 0x96, 0x78, 0xf9, 0xd2,
+	0x69, 0x3c, 0xb3, 0x6f, 0xcb, 0xdb, 0x42, 0x74, 0xe1, 0x81, 0x5f, 0x22,
+	0xd7, 0x1b, 0x25, 0xa7, 0xce, 0xf6, 0xcb, 0x80, 0xa1, 0x1e, 0xaa, 0xad,
+	0xdf, 0x1d, 0xb0, 0xe8, 0x22, 0xd1, 0x5e, 0x04, 0x2a, 0x20, 0x70, 0x63,
+	0x1f, 0x88, 0xba, 0xad, 0x83, 0x6a, 0x92, 0x5b, 0xdb, 0xdb, 0xc7, 0xef,
+	0x87, 0xfb, 0x15, 0xec, 0xa5, 0xb8, 0x96, 0x9f, 0x15, 0x49, 0x63, 0x80,
+	0x9c, 0xc9, 0x86, 0x33, 0xcd, 0x05, 0x2c, 0x3d, 0x42, 0x6b, 0xb3, 0xfc,
+	0x49, 0x2a, 0xc5, 0x02, 0x21, 0xec, 0x42, 0x96, 0xd0, 0x72, 0x13, 0x3f,
+	0x59, 0x28, 0x48, 0xc6, 0xf9, 0xab, 0xeb, 0xe1, 0x86, 0x01, 0xed, 0x68,
+	0xaf, 0x6f, 0x05, 0x51, 0xb3, 0x7a, 0xeb, 0x7e, 0xd1, 0xf0, 0x9b, 0xc4,
+	0x54, 0xbc, 0xa6, 0x8c, 0x44, 0xee, 0xc6, 0xf5, 0x29, 0xe9, 0x6f, 0xd3,
+	0xa9, 0x78, 0x32, 0xd0, 0x9a, 0x6d, 0xdd, 0x69, 0x83, 0xde, 0x33, 0x08,
+	0x23, 0x9b, 0x13, 0xa9, 0x48, 0x08, 0x68, 0x89, 0x1d, 0xb6, 0xa4, 0x39,
+	0xba, 0x75, 0xe8, 0xb0, 0x2c, 0x5d, 0x2c, 0x09, 0x52, 0x2d, 0x46, 0xc1,
+	0x37, 0x58, 0x52, 0x13, 0x59, 0x99, 0xd9, 0x86, 0xa2, 0x36, 0xb7, 0x1b,
+	0x79, 0x38, 0xf2, 0xcc, 0xf6, 0x84, 0x62, 0x01, 0xa8, 0x0c, 0x05, 0xab,
+	0xb6, 0xf5, 0xf8, 0x00, 0x41, 0xab, 0x05, 0x89, 0xa5, 0x91, 0x92, 0x06,
+	0x54, 0xcc, 0xd8, 0xbb, 0x9d, 0x92, 0x65, 0xf9, 0xfc, 0x57, 0x32, 0x2c,
+	0x17, 0x2f, 0x1d, 0xd0, 0xcf, 0x52, 0x7d, 0xde, 0xe4, 0xcd, 0x18, 0x90,
+	0xf2, 0x4b, 0x98, 0x87, 0x8e, 0x59, 0x20, 0x80, 0x73, 0x8a, 0xea, 0x87,
+	0xdf, 0x30, 0xbd, 0xe4, 0xb8, 0x70, 0x6a, 0x4d, 0xb8, 0x53, 0xaa, 0xdd,
+	0x34, 0x96, 0xc0, 0x75, 0xe9, 0xc9, 0xf2, 0x60, 0xbd, 0x1b, 0x75, 0x60,
+	0xf5, 0x83, 0x3a, 0x0f, 0xca, 0x8a, 0x7a, 0x16, 0xae, 0x0a, 0x2b, 0xfe,
+	0x6e, 0xe9, 0xae, 0xd5, 0x52, 0x4e, 0x76, 0x92, 0xaa, 0xa5, 0x3a, 0x74,
+	0x2b, 0xd7, 0xae, 0xa6, 0x56, 0xef, 0x03, 0x51, 0x5b, 0xe8, 0xa5, 0x39,
+	0xfb, 0xfe, 0x4e, 0x90, 0x66, 0x44, 0x5a, 0xd3, 0xbb, 0xf5, 0xb7, 0x63,
+	0x9c, 0x49, 0xaa, 0xe3, 0x75, 0x64, 0x03, 0x60, 0x9d, 0xa5, 0xa7, 0xad,
+	0x70, 0x5b, 0xd9, 0x62, 0x94, 0x86, 0x54, 0xca, 0x22, 0xf0, 0xd5, 0xdc,
+	0x7f, 0x88, 0x20, 0xe9, 0x8d, 0x35, 0x67, 0xb6, 0x4b, 0xe1, 0x99, 0x40,
+	0x19, 0x26, 0x21, 0x39, 0x32, 0x26, 0x8e, 0x83, 0x53, 0xc2, 0x5a, 0xd5,
+	0x1f, 0x40, 0x0f, 0xa2, 0xc4, 0xa5, 0xf1, 0xef, 0x5b, 0x6a, 0xa2, 0xb8,
+	0x2d, 0x5b, 0xf1, 0x0c, 0x4f, 0xa1, 0xaa, 0x5e, 0x72, 0x14, 0x02, 0xb6,
+	0x30, 0xd5, 0x31, 0x0b, 0xab, 0xbd, 0x11, 0xe9, 0x4a, 0xde, 0x8e, 0x0c,
+	0x8c, 0xa0, 0xdf, 0x99, 0x46, 0x77, 0xb3, 0x2b, 0x78, 0x45, 0xdc, 0x1e,
+	0x10, 0xf4, 0x63, 0x5c, 0xab, 0x4a, 0x5c, 0xef, 0x6b, 0x14, 0x92, 0x72,
+	0x7e, 0x78, 0xfc, 0xe6, 0x0a, 0x78, 0x09, 0xad, 0xc3, 0xfe, 0x28, 0x3b,
+	0x2f, 0x94, 0xee, 0xe4, 0xa1, 0x28, 0xae, 0xae, 0xa3, 0xd4, 0x8b, 0x46,
+	0xb3, 0xec, 0x73, 0x5b, 0xeb, 0xc2, 0xe3, 0x99, 0xdc, 0x44, 0x99, 0xb8,
+	0xf0, 0x41, 0x84, 0x5b, 0x25, 0xa3, 0x70, 0xa0, 0x5d, 0x7a, 0x02, 0xeb,
+	0x68, 0x4c, 0x08, 0x3f, 0x2b, 0x0d, 0x45, 0x96, 0x9f, 0x67, 0xff, 0x9a,
+	0x54, 0xc6, 0x97, 0xbd, 0x4f, 0xb8, 0xf2, 0x68, 0xeb, 0x23, 0x1f, 0xc8,
+	0x28, 0x29, 0xfd, 0xa8, 0x26, 0xe1, 0xfd, 0xae, 0x8a, 0x9a, 0x8d, 0x71,
+	0x7d, 0xa8, 0xf8, 0x51, 0xdc, 0xa7, 0xe5, 0x03, 0x72, 0xf1, 0x31, 0x3b,
+	0x99, 0x78, 0x6f, 0xd0, 0x71, 0x4d, 0x8e, 0x1c, 0x24, 0xd3, 0xf7, 0x1d,
+	0xff, 0x9d, 0x37, 0x35, 0x24, 0x81, 0xcd, 0x39, 0xfe, 0xa9, 0x8c, 0x18,
+	0x5c, 0x74, 0x26, 0x6a, 0x80, 0x27, 0x5a, 0x57, 0xe4, 0xad, 0x09, 0x2f,
+	0xfa, 0x3a, 0x6f, 0x64, 0x99, 0xde, 0x02, 0x7e, 0xb4, 0x8f, 0x4e, 0x28,
+	0x9a, 0x85, 0x56, 0x3b, 0xaf, 0x02, 0xc4, 0x01, 0x39, 0xde, 0x89, 0x26,
+	0x39, 0x82, 0xa5, 0xe8, 0x76, 0x7d, 0xa2, 0xc7, 0x3a, 0x35, 0x17, 0xc6,
+	0x5d, 0x29, 0x94, 0x83, 0x8b, 0x8b, 0xdd, 0x60, 0xda, 0xee, 0x5b, 0x80,
+	0x51, 0x4d, 0xbf, 0x3f, 0x0e, 0xc5, 0x72, 0xbb, 0xbb, 0x88, 0xd6, 0x68,
+	0xdc, 0xed, 0x54, 0x42, 0xf8, 0x83, 0xdd, 0xdc, 0xd1, 0x0f, 0x33, 0xda,
+	0x53, 0x6f, 0xcf, 0xa2, 0x9e, 0xa7, 0xe7, 0xec, 0xe1, 0x76, 0xfc, 0x51,
+	0xee, 0xee, 0xb9, 0x5d, 0xbe, 0x2d, 0x5e, 0x49, 0x58, 0x5e, 0xb0, 0x8a,
+	0x74, 0x8f, 0x0e, 0xfd, 0x8d, 0xdc, 0x98, 0x17, 0x1a, 0x3d, 0x99, 0x01,
+	0x04, 0x91, 0xd0, 0xd7, 0x62, 0xb1, 0xd3, 0x61, 0x69, 0x56, 0x92, 0x88,
+	0x3e, 0x79, 0x63, 0x1f, 0x57, 0x39, 0x09, 0x05, 0xea, 0xab, 0x82, 0xbd,
+	0x3c, 0x3b, 0xc7, 0x4c, 0x0a, 0x94, 0xa0, 0x4b, 0x89, 0xe5, 0x24, 0xcd,
+	0x16, 0x4a, 0x82, 0xe0, 0x22, 0x74, 0xfe, 0x5b, 0x04, 0x1b, 0x64, 0x2f,
+	0x55, 0xb6, 0xe6, 0xe9, 0x2e, 0x56, 0x8c, 0x9f, 0xd5, 0x48, 0xda, 0x34,
+	0x72, 0xca, 0x8a, 0x9e, 0xf5, 0x7a, 0x3c, 0x53, 0x24, 0xe6, 0x3d, 0x75,
+	0xfd, 0x2b, 0x47, 0x08, 0x0b, 0x9f, 0x13, 0x28, 0x52, 0x08, 0x51, 0xe2,
+	0x29, 0x46, 0x4e, 0xe9, 0x9d, 0xaa, 0x0d, 0xfb, 0x19, 0x97, 0x8e, 0xc9,
+	0x0c, 0xa0, 0xb9, 0x7f, 0x99, 0xab, 0x59, 0x68, 0x93, 0xd0, 0xf2, 0x4b,
+	0x96, 0x83, 0xfe, 0x19, 0xa5, 0x84, 0xe7, 0xd8, 0xac, 0x55, 0x3e, 0xec,
+	0xfe, 0x73, 0x84, 0xb7, 0xf7, 0x4d, 0x6d, 0x3e, 0x20, 0x7e, 0xb3, 0x8f,
+	0xdd, 0xb1, 0x7d, 0x6c, 0xc1, 0xd8, 0x5c, 0x5d, 0x57, 0x9b, 0x58, 0x2d,
+	0x95, 0xdf, 0x02, 0x2d, 0xe0, 0x89, 0xef, 0x02, 0xe9, 0xc6, 0xd6, 0xbc,
+	0x50, 0x88, 0x58, 0x08, 0x69, 0x5f, 0xcc, 0xb0, 0x7e, 0x6d, 0x29, 0x11,
+	0xdf, 0xf6, 0xff, 0x93, 0x58, 0x1f, 0x20, 0xa9, 0xdc, 0x2c, 0xfa, 0xdc,
+	0xbe, 0x4d, 0xf0, 0xba, 0x0b, 0xc7, 0x7b, 0x86, 0xfb, 0x59, 0x0f, 0xed,
+	0xc6, 0xe1, 0x15, 0x7a, 0x73, 0x41, 0xa0, 0xa5, 0x01, 0x44, 0xf5, 0x3b,
+	0x8e, 0x9e, 0x23, 0x82, 0xb5, 0x3b, 0x1d, 0x22, 0xf2, 0x78, 0xfa, 0xc1,
+	0x7a, 0x66, 0x08, 0xa1, 0xd0, 0x04, 0xfa, 0x53, 0x0d, 0xc9, 0x32, 0x5d,
+	0x78, 0xa6, 0x52, 0x69, 0x39, 0xe7, 0xa2, 0xec, 0x2b, 0x68, 0x3c, 0xad,
+	0xf8, 0x4f, 0xba, 0xb3, 0xd2, 0x41, 0x5e, 0x87, 0x98, 0x66, 0xb8, 0x7f,
+	0x44, 0x50, 0xbb, 0xf4, 0xfc, 0x93, 0xa9, 0xb6, 0xdd, 0x88, 0xf9, 0x9b,
+	0x26, 0x87, 0x33, 0x08, 0x67, 0x37, 0xf9, 0x32, 0x56, 0xcb, 0xb3, 0xba,
+	0x6e, 0x1e, 0xba, 0xa7, 0x3e, 0x14, 0xc0, 0x48, 0x3f, 0x95, 0x0b, 0x6e,
+	0xfb, 0x9c, 0xcd, 0x7d, 0xf9, 0x5a, 0xd9, 0xc3, 0x3f, 0xb6, 0x72, 0x4d,
+	0xd5, 0x8f, 0x23, 0xa2, 0x12, 0xf3, 0x66, 0x46, 0x42, 0x38, 0x3d, 0x29,
+	0x60, 0x0d, 0x59, 0x20, 0x78, 0xaf, 0x08, 0x24, 0xbc, 0xfa, 0x76, 0x85,
+	0x65, 0x10, 0xe9, 0x37, 0x58, 0x9d, 0x90, 0xef, 0x37, 0xb0, 0x0e, 0x8d,
+	0x72, 0x74, 0x4e, 0x4c, 0x4c, 0x7b, 0x99, 0x4e, 0x29, 0xc6, 0x4e, 0xc4,
+	0x54, 0xd0, 0x54, 0x9a, 0x0a, 0x0e, 0x6b, 0xdc, 0x04, 0x87, 0x4f, 0x26,
+	0x3d, 0x63, 0xcf, 0x1f, 0x92, 0x54, 0xa1, 0xec, 0xd9, 0x9f, 0x91, 0x6c,
+	0xd5, 0xcb, 0x7c, 0x40, 0x6f, 0x9b, 0x52, 0x30, 0x37, 0x54, 0xe7, 0xbb,
+	0x17, 0x4d, 0x41, 0x6e, 0x61, 0x1a, 0xf9, 0xbd, 0xa5, 0xd7, 0x81, 0xb4,
+	0xf8, 0x04, 0x99, 0xef, 0x7b, 0x8c, 0xc5, 0x56, 0xd0, 0xa4, 0x71, 0x5f,
+	0x9f, 0x29, 0x67, 0xbb, 0xdc, 0xcb, 0x4c, 0x2d, 0x24, 0x73, 0xab, 0xcd,
+	0x4b, 0x4e, 0xaf, 0xa1, 0x7c, 0xba, 0xd7, 0xf4, 0xb8, 0xd9, 0x1d, 0x29,
+	0x52, 0x71, 0x70, 0x0c, 0x9c, 0xca, 0xc1, 0x0c, 0x56, 0x2d, 0xe9, 0xe9,
+	0xd4, 0x82, 0xb1, 0x18, 0x5e, 0x95, 0x97, 0x03, 0x45, 0x68, 0x1f, 0x8e,
+	0xa6, 0x5e, 0xe4, 0x7c, 0xe2, 0xdc, 0x9c, 0x9c, 0x3b, 0x74, 0xbb, 0xed,
+	0x62, 0x59, 0xce, 0x25, 0x1b, 0xb0, 0x0e, 0x86, 0x20, 0xf4, 0xc1, 0xed,
+	0x06, 0xfb, 0x3f, 0xbb, 0x32, 0x49, 0x5c, 0xfd, 0x49, 0xda, 0xe7, 0x2a,
+	0xad, 0xb7, 0x9b, 0xa0, 0x6d, 0x17, 0xba, 0x2a, 0x67, 0x42, 0xdb, 0x31,
+	0x8d, 0x9a, 0x2b, 0x3e, 0x6d, 0x6f, 0x5e, 0x4c, 0x19, 0x42, 0xc3, 0x23,
+	0x4d, 0x63, 0x47, 0xd1, 0xa2, 0x35, 0x99, 0xe2, 0x66, 0x9f, 0x38, 0xa8,
+	0xb2, 0xd1, 0xc9, 0x46, 0xa1, 0xd4, 0xe9, 0xe9, 0xb0, 0xdc, 0x0d, 0x46,
+	0xda, 0xb5, 0x7f, 0x67, 0xd0, 0x03, 0xd3, 0xad, 0x7c, 0x3f, 0x32, 0x3c,
+	0xb3, 0x56, 0x30, 0xe4, 0x4e, 0xb4, 0xd5, 0xd7, 0xa1, 0x8d, 0x0c, 0x6e,
+	0xb3, 0xe7, 0x1a, 0xfe, 0xba, 0x1c, 0x89, 0x06, 0x78, 0xa2, 0x5c, 0x77,
+	0x0d, 0x55, 0x76, 0x3e, 0x3f, 0x18, 0x28, 0x85, 0x46, 0xc0, 0xae, 0xb3,
+	0xfb, 0xbb, 0x25, 0x5b, 0xb6, 0xc7, 0x5c, 0xe5, 0xe3, 0x39, 0x2c, 0x01,
+	0x83, 0xa6, 0xb1, 0x8a, 0xbf, 0xaf, 0x35, 0x9c, 0x3f, 0xdc, 0xe0, 0xea,
+	0xa2, 0x31, 0x4d, 0x3c, 0x04, 0x5b, 0xeb, 0x06, 0x40, 0xed, 0xa2, 0x30,
+	0xd0, 0x00, 0xbe, 0x26, 0xe8, 0x0b, 0x12, 0x1f, 0x00, 0x00, 0x02, 0xab,
+	0x2c, 0xb2, 0x7e, 0x46, 0xc0, 0x82, 0xfa, 0xa1, 0x3a, 0x54, 0x68, 0x9d,
+	0x9c, 0x83, 0x10, 0x8a, 0x94, 0xde, 0x94, 0xd4, 0x4d, 0xc6, 0x6d, 0x75,
+	0xbd, 0xbf, 0x0e, 0x40, 0x5a, 0xf9, 0xfc, 0xc7, 0x0d, 0xc3, 0xd4, 0xea,
+	0xb7, 0x82, 0x5e, 0x0b, 0xbe, 0x93, 0xf2, 0x2a, 0x8c, 0x01, 0xbc, 0xb3,
+	0xb5, 0x3a, 0x2d, 0xf8, 0x7e, 0xad, 0x3b, 0x24, 0x11, 0xf0, 0x6c, 0x62,
+	0x55, 0x46, 0x24, 0x62, 0xf3, 0x01, 0xfb, 0x3f, 0xc2, 0x00, 0x79, 0x93,
+	0xca, 0x01, 0x69, 0x54, 0xf0, 0xba, 0xa1, 0x99, 0x3f, 0x9c, 0xbb, 0x45,
+	0xb1, 0x5e, 0xab, 0xee, 0xa8, 0xe6, 0x4d, 0x84, 0xb2, 0x84, 0xfb, 0x5f,
+	0x3e, 0xe7, 0x29, 0xeb, 0xba, 0x47, 0x96, 0xd6, 0xab, 0x61, 0x4b, 0x7e,
+	0x25, 0x36, 0x8c, 0xb1, 0x0e, 0xf7, 0x18, 0xc9, 0x77, 0xb1, 0x92, 0x5f,
+	0xb3, 0x47, 0x02, 0xd3, 0x1b, 0x7e, 0x1d, 0x56, 0x14, 0x40, 0xc7, 0xf8,
+	0x9e, 0x30, 0xbe, 0xf3, 0xee, 0x8d, 0x85, 0x81, 0x3c, 0x7d, 0xfc, 0x25,
+	0x41, 0xc7, 0x37, 0x1f, 0x2a, 0xb2, 0xe5, 0xe0, 0x6b, 0x72, 0x94, 0xdc,
+	0xca, 0xed, 0xba, 0x8d, 0x89, 0x07, 0xac, 0x4f, 0xe0, 0xf0, 0x8e, 0x03,
+	0xcd, 0xc1, 0x0e, 0x13, 0xa5, 0x84, 0xf1, 0x26, 0x15, 0xca, 0xdc, 0x5c,
+	0xc1, 0xf4, 0xa0, 0x4e, 0xa6, 0x50, 0xbb, 0x17, 0x07, 0x4e, 0x01, 0x5b,
+	0x6e, 0x2c, 0x2a, 0x40, 0x06, 0x2c, 0x2c, 0x9b, 0xad, 0x37, 0xb5, 0x8e,
+	0x77, 0x5a, 0x44, 0x15, 0xd3, 0x66, 0xf2, 0x3d, 0x5f, 0x3c, 0xec, 0xb8,
+	0x1d, 0x45, 0xfd, 0x10, 0x84, 0xcd, 0xde, 0xe1, 0xee, 0x84, 0xb6, 0xbe,
+	0x16, 0x75, 0x20, 0xf3, 0x3a, 0x0f, 0x65, 0x97, 0xcc, 0xfc, 0x69, 0x53,
+	0xaa, 0x67, 0x9b, 0x44, 0xf4, 0xd9, 0xde, 0xc5, 0x59, 0x70, 0x05, 0x48,
+	0xbe, 0x64, 0x4a, 0xdd, 0x6e, 0xc7, 0xa4, 0xee, 0xbb, 0x0c, 0x33, 0x78,
+	0xc8, 0x86, 0xa7, 0x52, 0x99, 0x0a, 0xbc, 0xa5, 0xa9, 0xda, 0x31, 0xdd,
+	0xd6, 0x2c, 0xc9, 0xd2, 0x7f, 0x63, 0x13, 0x36, 0x83, 0x29, 0x20, 0xe6,
+	0x0e, 0xcb, 0x71, 0x84, 0xd1, 0xfd, 0x1e, 0x84, 0x59, 0x10, 0x95, 0x4c,
+	0x8b, 0xd9, 0xc4, 0x1e, 0xd7, 0x34, 0x8f, 0x68, 0x37, 0x29, 0x94, 0x0d,
+	0x95, 0x66, 0x14, 0xf6, 0x36, 0xc2, 0x3d, 0x6c, 0x17, 0x7e, 0x68, 0xb6,
+	0x39, 0x54, 0x89, 0x10, 0x40, 0x32, 0x8a, 0x8f, 0x35, 0xb5, 0xd1, 0xd3,
+	0xb9, 0x6c, 0xc7, 0x9a, 0x80, 0x0c, 0xc4, 0x47, 0xf8, 0x66, 0xca, 0x32,
+	0x6d, 0x57, 0xcf, 0x14, 0x13, 0x9b, 0xe7, 0xed, 0x4a, 0xc7, 0xc2, 0xdf,
+	0xda, 0x94, 0xe4, 0x3d, 0x02, 0x00, 0xba, 0x77, 0xdc, 0xa3, 0xf8, 0xa7,
+	0x83, 0xe1, 0x78, 0x93, 0xfe, 0xf1, 0x88, 0x80, 0x26, 0x0d, 0x0f, 0x10,
+	0x16, 0x4e, 0x51, 0x57, 0xf4, 0x08, 0x41, 0xbb, 0xfa, 0x5a, 0x24, 0x46,
+	0x59, 0x6f, 0xcf, 0xc0, 0xfe, 0x05, 0x8f, 0x93, 0x52, 0xb3, 0xcb, 0x5a,
+	0x4b, 0x6a, 0x16, 0x83, 0x86, 0x7f, 0x51, 0xf7, 0xfa, 0xd9, 0xf5, 0xe5,
+	0xa0, 0xe6, 0xd7, 0x60, 0xa7, 0x39, 0xb4, 0xc8, 0x0a, 0x42, 0xfa, 0x85,
+	0x76, 0xc5, 0x70, 0x05, 0xe4, 0xb9, 0x7e, 0x06, 0x79, 0x61, 0x68, 0x36,
+	0x67, 0x33, 0x9a, 0x2c, 0x86, 0xa8, 0x09, 0x3f, 0xfa, 0x3d, 0x45, 0xb2,
+	0x8b, 0x23, 0x0b, 0x84, 0x36, 0xf9, 0x78, 0x0e, 0x86, 0xb5, 0x1e, 0x19,
+	0xeb, 0x84, 0x67, 0xda, 0xdf, 0x45, 0x44, 0x73, 0x60, 0xa0, 0x27, 0xc4,
+	0x4b, 0x96, 0xfe, 0x8c, 0xac, 0x50, 0x65, 0xe3, 0x49, 0xe6, 0x5e, 0xb3,
+	0x05, 0x54, 0xe2, 0xd1, 0x5f, 0x4f, 0x99, 0x67, 0x04, 0x87, 0x9e, 0x43,
+	0xb2, 0x8b, 0xfd, 0xcc, 0x54, 0x45, 0x06, 0x81, 0xc9, 0x46, 0x2d, 0x55,
+	0x3b, 0x7b, 0x79, 0xad, 0x92, 0x79, 0x05, 0xd1, 0x67, 0x10, 0xc2, 0x6b,
+	0xb3, 0xf8, 0xa9, 0xd5, 0x80, 0x19, 0x99, 0x95, 0xfc, 0x79, 0x85, 0xa0,
+	0x24, 0x94, 0xbb, 0x0d, 0x7d, 0x4a, 0x65, 0x73, 0xc2, 0x31, 0xd9, 0x0a,
+	0x48, 0xfc, 0x40, 0x2e, 0xe7, 0x3c, 0x4b, 0x42, 0x4a, 0xa4, 0x91, 0xcf,
+	0xd1, 0x94, 0x93, 0xa9, 0x97, 0xad, 0xc3, 0x0c, 0xc5, 0x81, 0x5a, 0x62,
+	0xee, 0x80, 0x5d, 0xb5, 0x74, 0x89, 0x65, 0x4b, 0xbb, 0xc0, 0x8f, 0xa7,
+	0xfa, 0xa2, 0x93, 0x68, 0xd9, 0x32, 0x02, 0x12, 0xa7, 0xd9, 0xd1, 0x83,
+	0xd3, 0x81, 0xe7, 0xcd, 0x8b, 0x1e, 0xae, 0x3d, 0xec, 0x4a, 0x94, 0x40,
+	0x90, 0xef, 0x72, 0xcb, 0x76, 0xeb, 0xdd, 0xbe, 0x20, 0x86, 0x6d, 0x30,
+	0xfb, 0x5e, 0x3c, 0x76, 0x41, 0x93, 0x2d, 0x32, 0xa0, 0x3d, 0x93, 0x21,
+	0xed, 0x76, 0x8c, 0xe1, 0xee, 0x22, 0x42, 0x84, 0x90, 0x1a, 0xad, 0xca,
+	0x4e, 0xd0, 0x1a, 0x17, 0xea, 0xf2, 0x6e, 0x63, 0xe8, 0x11, 0x18, 0x65,
+	0x81, 0xc9, 0xf2, 0x64, 0xac, 0x61, 0x65, 0xa4, 0xbe, 0x4e, 0x29, 0x2c,
+	0xba, 0xbe, 0x59, 0xc5, 0x97, 0xb9, 0x04, 0x59, 0xf7, 0x7b, 0x0b, 0xcc,
+	0xb5, 0x27, 0xcf, 0x6e, 0x72, 0x30, 0xa2, 0xd9, 0x5e, 0xcc, 0x5c, 0xd3,
+	0x48, 0x20, 0x69, 0xbc, 0x5d, 0xb7, 0x22, 0xed, 0xbd, 0x45, 0xe4, 0xcc,
+	0xeb, 0xb3, 0x23, 0x7c, 0x98, 0x31, 0x51, 0x73, 0x8e, 0x90, 0x95, 0x44,
+	0xf4, 0x89, 0x65, 0x9a, 0xed, 0xd2, 0x43, 0x4c, 0x7d, 0x64, 0x0d, 0x49,
+	0x14, 0x6c, 0x6d, 0xac, 0x37, 0x5b, 0xd8, 0xd2, 0x11, 0x39, 0xc7, 0xc0,
+	0xd3, 0x70, 0xd6, 0xf0, 0xbc, 0x61, 0x86, 0x9d, 0x6b, 0xb6, 0xc0, 0x95,
+	0x1b, 0x47, 0x96, 0xd0, 0xc7, 0x7e, 0x7d, 0x08, 0x74, 0x33, 0x74, 0x32,
+	0x24, 0x24, 0xa9, 0xb5, 0x4b, 0x43, 0xa6, 0xa3, 0xe9, 0x7c, 0x98, 0x7b,
+	0x3b, 0xf1, 0x24, 0x0d, 0xf5, 0xbf, 0xb7, 0xf6, 0x9a, 0xcd, 0x0d, 0x6f,
+	0xc7, 0xa2, 0xe1, 0x95, 0xef, 0xb4, 0x50, 0xdc, 0x7e, 0xfc, 0xb2, 0x08,
+	0xa9, 0x96, 0xb9, 0x99, 0x9d, 0x11, 0xbc, 0xb4, 0x8f, 0xcc, 0x6e, 0x72,
+	0xaf, 0xaf, 0x70, 0x77, 0x4f, 0xb9, 0x1c, 0x81, 0x11, 0xed, 0xf0, 0x9d,
+	0x13, 0x52, 0x56, 0x3d, 0x94, 0xe9, 0x87, 0x33, 0x06, 0xe5, 0xa2, 0xdd,
+	0x00, 0xf9, 0x2f, 0xf7, 0x6f, 0xb8, 0x15, 0x11, 0x8b, 0x82, 0x2e, 0x7b,
+	0x3a, 0xee, 0x2d, 0x4e, 0x27, 0x90, 0x8a, 0xfc, 0x1c, 0x78, 0x17, 0x13,
+	0xc8, 0x2d, 0xb5, 0x99, 0xfe, 0x18, 0x87, 0xf0, 0x76, 0xaa, 0xf4, 0xfd,
+	0x40, 0x5a, 0xdf, 0x80, 0xd5, 0xd0, 0x18, 0x88, 0x57, 0x3d, 0xe1, 0xf4,
+	0xd3, 0x7c, 0xbf, 0xe1, 0xb8, 0x99, 0x16, 0x3a, 0x90, 0x67, 0xcc, 0x17,
+	0x47, 0xe0, 0x28, 0xea, 0x6f, 0x7c, 0xea, 0x24, 0x79, 0x7d, 0x4b, 0x8a,
+	0x7f, 0x65, 0xaf, 0xed, 0x9b, 0xa1, 0xf3, 0x91, 0xd6, 0x8e, 0xca, 0xed,
+	0xfc, 0x8f, 0x6d, 0x40, 0x18, 0x19, 0x28, 0x56, 0x09, 0x09, 0x0f, 0x39,
+	0xf9, 0x27, 0x93, 0xd8, 0xf3, 0x76, 0x0d, 0x69, 0x48, 0x17, 0xf5, 0x61,
+	0x41, 0x05, 0xe3, 0x66, 0x7d, 0xe5, 0x63, 0xe0, 0xdb, 0x33, 0x7a, 0x41,
+	0x93, 0xa1, 0xf6, 0xdc, 0x60, 0x82, 0xac, 0x21, 0xe8, 0xb1, 0x11, 0x48,
+	0xba, 0x30, 0x9b, 0x20, 0x1c, 0xa4, 0xe9, 0x8f, 0x6d, 0xe6, 0xba, 0x52,
+	0x49, 0xd3, 0x0c, 0xac, 0xc5, 0x5b, 0x4f, 0x33, 0x7c, 0xfa, 0x02, 0xb0,
+	0xb3, 0xcd, 0xd5, 0xae, 0xd2, 0x12, 0x56, 0xc0, 0xb4, 0x94, 0x3d, 0x1c,
+	0x3f, 0xac, 0x3f, 0xb6, 0xfe, 0xeb, 0xca, 0x8f, 0x23, 0x15, 0xc1, 0x9f,
+	0xba, 0xc7, 0x74, 0x61, 0xaa, 0x77, 0x65, 0xf6, 0x60, 0xca, 0x8f, 0xf6,
+	0x30, 0xca, 0x1e, 0x84, 0x31, 0x60, 0x1e, 0x49, 0xbb, 0x9f, 0x7b, 0xe8,
+	0x22, 0x0b, 0x2d, 0xf6, 0x58, 0x02, 0xe5, 0xe1, 0x9c, 0x03, 0x4d, 0x70,
+	0x9d, 0xfa, 0xef, 0x43, 0x07, 0xfe, 0x76, 0xc9, 0xf3, 0x80, 0x54, 0xe1,
+	0x1c, 0x6d, 0xee, 0x98, 0x06, 0x42, 0xa0, 0xd6, 0x5a, 0x7b, 0x37, 0x3a,
+	0x14, 0x8d, 0xae, 0xc9, 0x67, 0x59, 0x58, 0x96, 0x08, 0x99, 0x43, 0x05,
+	0xa7, 0x47, 0x17, 0x77, 0x86, 0x97, 0x24, 0x22, 0xa6, 0x3e, 0xf1, 0x86,
+	0x4d, 0xf9, 0x69, 0xe0, 0xdd, 0x1d, 0x46, 0x8a, 0xbc, 0xc6, 0x7f, 0xe6,
+	0x98, 0x65, 0xab, 0x78, 0x4f, 0x0e, 0xbf, 0x14, 0x9f, 0x60, 0x9e, 0x24,
+	0xe0, 0x81, 0x3b, 0xde, 0xbc, 0xcb, 0xc9, 0x9c, 0x44, 0xf1, 0x23, 0xaa,
+	0xd7, 0x3b, 0xf9, 0x66, 0xb0, 0x9e, 0xb9, 0xab, 0x89, 0x4e, 0xc7, 0x11,
+	0x91, 0x55, 0xed, 0x38, 0x6c, 0x02, 0x08, 0xdc, 0x0c, 0xfa, 0x41, 0x5f,
+	0xea, 0x45, 0xbf, 0xe3, 0x1b, 0x1d, 0x7e, 0xb3, 0xd5, 0x60, 0x3b, 0xb1,
+	0xbd, 0xbc, 0x4a, 0xc1, 0x67, 0xef, 0xf0, 0xfb, 0x5a, 0x73, 0x34, 0xc9,
+	0x4e, 0x45, 0x8f, 0x34, 0x9b, 0x98, 0xaa, 0xb8, 0xb2, 0x7d, 0x7c, 0xbb,
+	0x12, 0x3e, 0x52, 0x04, 0x70, 0xc4, 0x89, 0x6d, 0xc0, 0x7d, 0x6a, 0xd4,
+	0x92, 0x1a, 0x84, 0x2e, 0x56, 0x2f, 0x6f, 0x1f, 0x52, 0xc6, 0x5c, 0x87,
+	0x76, 0x6e, 0xf7, 0x95, 0x53, 0x0a, 0xce, 0x7a, 0x87, 0xf9, 0x6f, 0x92,
+	0x75, 0xed, 0x5c, 0x92, 0xe5, 0x38, 0x43, 0x5a, 0x99, 0x3a, 0xf1, 0xac,
+	0x4c, 0x9b, 0x36, 0x07, 0xac, 0x2a, 0xbb, 0xe6, 0x0d, 0x47, 0x9b, 0xd0,
+	0x78, 0xbb, 0xc0, 0xf3, 0x92, 0xc4, 0xdb, 0x48, 0x00, 0x61, 0x08, 0x0c,
+	0x1d, 0x01, 0x62, 0xd3, 0x10, 0x90, 0x4e, 0x35, 0xb5, 0x7d, 0x90, 0x5f,
+	0x66, 0x08, 0xf0, 0x1b, 0x3d, 0x01, 0x75, 0x39, 0x50, 0x1b, 0x7e, 0x30,
+	0x3c, 0x7b, 0x07, 0x0c, 0xe2, 0x67, 0x28, 0xf1, 0xc3, 0xfb, 0x88, 0x85,
+	0xd6, 0x58, 0x04, 0xcb, 0xff, 0xb9, 0x83, 0xed, 0x85, 0xc8, 0xd1, 0x90,
+	0x99, 0x83, 0xb9, 0x6d, 0xec, 0x66, 0x00, 0x65, 0xba, 0xc4, 0xe6, 0x8e,
+	0xcf, 0x6c, 0x26, 0x6d, 0xe2, 0xe4, 0x02, 0xd6, 0x34, 0x18, 0xe8, 0x25,
+	0xc7, 0xa2, 0x6f, 0xaa, 0x13, 0xab, 0x44, 0xe0, 0x0a, 0x9f, 0xbc, 0xa6,
+	0x02, 0xeb, 0x0b, 0xa8, 0x6a, 0x70, 0x01, 0x85, 0x8a, 0x66, 0xe0, 0xd0,
+	0x60, 0xbc, 0x16, 0x64, 0xb8, 0xea, 0xc4, 0x70, 0xa7, 0xb4, 0x80, 0xfa,
+	0x4a, 0xf3, 0x7c, 0xf1, 0xdd, 0x62, 0x0d, 0xb7, 0x5a, 0x75, 0x1a, 0xa3,
+	0xf5, 0xde, 0xd8, 0x5c, 0xcd, 0x49, 0x65, 0x4d, 0x6a, 0xef, 0xd5, 0x96,
+	0x96, 0xcb, 0x5c, 0x53, 0xde, 0x7b, 0x31, 0x02, 0x52, 0xb7, 0x8a, 0x0d,
+	0xc0, 0x7c, 0xe5, 0x12, 0xe9, 0xd7, 0x02, 0xd3, 0xdd, 0x97, 0xe1, 0xcd,
+	0x6c, 0x0d, 0x03, 0xc7, 0x7f, 0x8b, 0x48, 0x14, 0xab, 0xc2, 0x88, 0xfb,
+	0x23, 0xd3, 0xc1, 0x3b, 0x71, 0x7e, 0xbe, 0x0a, 0x2f, 0x4b, 0x0f, 0x13,
+	0x18, 0xe4, 0x31, 0x90, 0x00, 0x8b, 0xfa, 0x6b, 0xb2, 0x04, 0x2e, 0x86,
+	0x3b, 0x45, 0x7a, 0xaf, 0xc6, 0x9c, 0x85, 0xd7, 0xdb, 0x4f, 0x03, 0x3c,
+	0xd9, 0x29, 0xad, 0xa9, 0xf7, 0x96, 0xbd, 0xc6, 0x69, 0x0d, 0x23, 0xc4,
+	0xb9, 0x19, 0x32, 0xa7, 0x27, 0x13, 0x7c, 0x36, 0x7c, 0xf3, 0xb9, 0x28,
+	0xdd, 0xd7, 0x60, 0x35, 0xbf, 0xfb, 0x4b, 0xea, 0x2a, 0x30, 0x1c, 0xb1,
+	0xef, 0xd1, 0x5b, 0x52, 0x1f, 0x79, 0xe8, 0xd3, 0x23, 0xbb, 0x7f, 0x61,
+	0x4b, 0x53, 0x08, 0x5a, 0xf4, 0x54, 0xdd, 0x0d, 0x75, 0xb0, 0xc8, 0xb6,
+	0xf4, 0xef, 0x45, 0x5e, 0xb7, 0x8f, 0xe2, 0xb5, 0xaf, 0x0e, 0x0f, 0x64,
+	0x36, 0x48, 0x8a, 0xbb, 0xcd, 0xbf, 0xac, 0x2a, 0x44, 0x86, 0x8c, 0x8f,
+	0x9f, 0x22, 0xfd, 0xd6, 0xdf, 0xb1, 0xfb, 0xe4, 0xd2, 0xeb, 0x17, 0x2b,
+	0x4e, 0x4c, 0xb4, 0x73, 0xfe, 0xb7, 0xf2, 0xe3, 0xa0, 0xd6, 0xce, 0xa3,
+	0xa9, 0x71, 0x32, 0x10, 0xf6, 0xb2, 0x9e, 0xec, 0x98, 0xf5, 0xb5, 0x84,
+	0xf6, 0xea, 0xe9, 0x42, 0xab, 0x98, 0xf4, 0xd1, 0xe5, 0x2d, 0x43, 0x8a,
+	0xeb, 0x96, 0x15, 0x38, 0x63, 0x46, 0x9c, 0x79, 0x1c, 0x6f, 0xcd, 0x95,
+};
+
+static const uint8_t target_img[] = {
+	0x3a, 0xab, 0xac, 0x26, 0xaf, 0x23, 0x1a, 0x71, 0x6c, 0x91, 0x5d, 0x31,
+	0x18, 0x3e, 0xbc, 0xd2, 0xef, 0x51, 0x22, 0x9d, 0x72, 0x4f, 0xdb, 0xd9,
+	0x6f, 0x39, 0x6e, 0xae, 0x2b, 0xc8, 0x22, 0x2f, 0x0c, 0xe3, 0xed, 0x8c,
+	0x68, 0x7b, 0xa2, 0x89, 0x99, 0xd6, 0x39, 0xa7, 0x9f, 0xf2, 0x55, 0xfe,
+	0x91, 0x15, 0xb8, 0x20, 0xaa, 0x7a, 0x94, 0x8a, 0xa0, 0x4d, 0xc0, 0x9d,
+	0xfe, 0x49, 0x4c, 0xdc, 0x8e, 0xe0, 0xb9, 0x06, 0xb2, 0x30, 0x29, 0x4a,
+	0x60, 0x1c, 0xdf, 0x3c, 0xb7, 0x62, 0xcf, 0x42, 0x05, 0x19, 0x0c, 0x4b,
+	0xb3, 0xdf, 0xe1, 0x7c, 0x45, 0xfb, 0x50, 0x51, 0x67, 0x70, 0x78, 0xc9,
+	0x04, 0xf8, 0x43, 0x0c, 0xb4, 0x48, 0x73, 0xcb, 0xc6, 0x05, 0xd8, 0x9f,
+	0x58, 0xf0, 0x6d, 0xd7, 0xe5, 0x38, 0xac, 0xee, 0xef, 0xed, 0xfc, 0xef,
+	0x97, 0xfe, 0x16, 0x37, 0xbc, 0x03, 0xe7, 0xaa, 0xb0, 0x65, 0x38, 0x43,
+	0x49, 0xd7, 0x59, 0x3b, 0xe0, 0x7f, 0x7f, 0xe2, 0xa3, 0xc9, 0xd6, 0xae,
+	0x2a, 0x67, 0x66, 0xed, 0xab, 0xb5, 0x4d, 0x73, 0xff, 0x96, 0x8a, 0x23,
+	0x32, 0x0b, 0x97, 0xef, 0x1c, 0x7d, 0xba, 0x41, 0x96, 0x78, 0xf9, 0xd2,
+	0x69, 0x3c, 0xb3, 0x6f, 0xcb, 0xdb, 0x42, 0x74, 0xe1, 0x81, 0x5f, 0x22,
+	0xd7, 0x1b, 0x25, 0xa7, 0xce, 0xf6, 0xcb, 0x80, 0xa1, 0x1e, 0xaa, 0xad,
+	0xdf, 0x1d, 0xb0, 0xe8, 0x22, 0xd1, 0x5e, 0x04, 0x2a, 0x20, 0x70, 0x63,
+	0x1f, 0x88, 0xba, 0xad, 0x83, 0x6a, 0x92, 0x5b, 0xdb, 0xdb, 0xc7, 0xef,
+	0x87, 0xfb, 0x15, 0xec, 0xa5, 0xb8, 0x96, 0x9f, 0x15, 0x49, 0x63, 0x80,
+	0x9c, 0xc9, 0x86, 0x33, 0xcd, 0x05, 0x2c, 0x3d, 0x42, 0x6b, 0xb3, 0xfc,
+	0x49, 0x2a, 0xc5, 0x02, 0x21, 0xec, 0x42, 0x96, 0xd0, 0x72, 0x13, 0x3f,
+	0x59, 0x28, 0x48, 0xc6, 0xf9, 0xab, 0xeb, 0xe1, 0x86, 0x01, 0xed, 0x68,
+	0xaf, 0x6f, 0x05, 0x51, 0xb3, 0x7a, 0xeb, 0x7e, 0xd1, 0xf0, 0x9b, 0xc4,
+	0x54, 0xbc, 0xa6, 0x8c, 0x44, 0xee, 0xc6, 0xf5, 0x29, 0xe9, 0x6f, 0xd3,
+	0xa9, 0x78, 0x32, 0xd0, 0x9a, 0x6d, 0xdd, 0x69, 0x83, 0xde, 0x33, 0x08,
+	0x23, 0x9b, 0x13, 0xa9, 0x48, 0x08, 0x68, 0x89, 0x1d, 0xb6, 0xa4, 0x39,
+	0xba, 0x75, 0xe8, 0xb0, 0x2c, 0x5d, 0x2c, 0x09, 0x52, 0x2d, 0x46, 0xc1,
+	0x37, 0x58, 0x52, 0x13, 0x59, 0x99, 0xd9, 0x86, 0xa2, 0x36, 0xb7, 0x1b,
+	0x79, 0x38, 0xf2, 0xcc, 0xf6, 0x84, 0x62, 0x01, 0xa8, 0x0c, 0x05, 0xab,
+	0xb6, 0xf5, 0xf8, 0x00, 0x41, 0xab, 0x05, 0x89, 0xa5, 0x91, 0x92, 0x06,
+	0x54, 0xcc, 0xd8, 0xbb, 0x9d, 0x92, 0x65, 0xf9, 0xfc, 0x57, 0x32, 0x2c,
+	0x17, 0x2f, 0x1d, 0xd0, 0xcf, 0x52, 0x7d, 0xde, 0xe4, 0xcd, 0x18, 0x90,
+	0xf2, 0x4b, 0x98, 0x87, 0x8e, 0x59, 0x20, 0x80, 0x73, 0x8a, 0xea, 0x87,
+	0xdf, 0x30, 0xbd, 0xe4, 0xb8, 0x70, 0x6a, 0x4d, 0xb8, 0x53, 0xaa, 0xdd,
+	0x34, 0x96, 0xc0, 0x75, 0xe9, 0xc9, 0xf2, 0x60, 0xbd, 0x1b, 0x75, 0x60,
+	0xf5, 0x83, 0x3a, 0x0f, 0xca, 0x8a, 0x7a, 0x16, 0xae, 0x0a, 0x2b, 0xfe,
+	0x6e, 0xe9, 0xae, 0xd5, 0x52, 0x4e, 0x76, 0x92, 0xaa, 0xa5, 0x3a, 0x74,
+	0x2b, 0xd7, 0xae, 0xa6, 0x56, 0xef, 0x03, 0x51, 0x5b, 0xe8, 0xa5, 0x39,
+	0xfb, 0xfe, 0x4e, 0x90, 0x66, 0x44, 0x5a, 0xd3, 0xbb, 0xf5, 0xb7, 0x63,
+	0x9c, 0x49, 0xaa, 0xe3, 0x75, 0x64, 0x03, 0x60, 0x9d, 0xa5, 0xa7, 0xad,
+	0x70, 0x5b, 0xd9, 0x62, 0x94, 0x86, 0x54, 0xca, 0x22, 0xf0, 0xd5, 0xdc,
+	0x7f, 0x88, 0x20, 0xe9, 0x8d, 0x35, 0x67, 0xb6, 0x15, 0x4a, 0x38, 0xf0,
+	0xbe, 0xb6, 0x4a, 0xa6, 0xd2, 0x78, 0xf1, 0x60, 0xf3, 0x5d, 0x56, 0xaf,
+	0x64, 0x83, 0x12, 0x94, 0xc4, 0xa5, 0xf1, 0xef, 0x5b, 0x6a, 0xa2, 0xb8,
+	0x2d, 0x5b, 0xf1, 0x0c, 0x4f, 0xa1, 0xaa, 0x5e, 0x72, 0x14, 0x02, 0xb6,
+	0x30, 0xd5, 0x31, 0x0b, 0xab, 0xbd, 0x11, 0xe9, 0x4a, 0xde, 0x8e, 0x0c,
+	0x8c, 0xa0, 0xdf, 0x99, 0x46, 0x77, 0xb3, 0x2b, 0x78, 0x45, 0xdc, 0x1e,
+	0x10, 0xf4, 0x63, 0x5c, 0xab, 0x4a, 0x5c, 0xef, 0x6b, 0x14, 0x92, 0x72,
+	0x7e, 0x78, 0xfc, 0xe6, 0x0a, 0x78, 0x09, 0xad, 0xc3, 0xfe, 0x28, 0x3b,
+	0x2f, 0x94, 0xee, 0xe4, 0xa1, 0x28, 0xae, 0xae, 0xa3, 0xd4, 0x8b, 0x46,
+	0xb3, 0xec, 0x73, 0x5b, 0xeb, 0xc2, 0xe3, 0x99, 0xdc, 0x44, 0x99, 0xb8,
+	0xf0, 0x41, 0x84, 0x5b, 0x25, 0xa3, 0x70, 0xa0, 0x5d, 0x7a, 0x02, 0xeb,
+	0x68, 0x4c, 0x08, 0x3f, 0x2b, 0x0d, 0x45, 0x96, 0x9f, 0x67, 0xff, 0x9a,
+	0x54, 0xc6, 0x97, 0xbd, 0x4f, 0xb8, 0xf2, 0x68, 0xeb, 0x23, 0x1f, 0xc8,
+	0x28, 0x29, 0xfd, 0xa8, 0x26, 0xe1, 0xfd, 0xae, 0x8a, 0x9a, 0x8d, 0x71,
+	0x7d, 0xa8, 0xf8, 0x51, 0xdc, 0xa7, 0xe5, 0x03, 0x72, 0xf1, 0x31, 0x3b,
+	0x99, 0x78, 0x6f, 0xd0, 0x71, 0x4d, 0x8e, 0x1c, 0x24, 0xd3, 0xf7, 0x1d,
+	0xff, 0x9d, 0x37, 0x35, 0x24, 0x81, 0xcd, 0x39, 0xfe, 0xa9, 0x8c, 0x18,
+	0x5c, 0x74, 0x26, 0x6a, 0x80, 0x27, 0x5a, 0x57, 0xe4, 0xad, 0x09, 0x2f,
+	0xfa, 0x3a, 0x6f, 0x64, 0x99, 0xde, 0x02, 0x7e, 0xb4, 0x8f, 0x4e, 0x28,
+	0x9a, 0x85, 0x56, 0x3b, 0xaf, 0x02, 0xc4, 0x01, 0x39, 0xde, 0x89, 0x26,
+	0x39, 0x82, 0xa5, 0xe8, 0x76, 0x7d, 0xa2, 0xc7, 0x3a, 0x35, 0x17, 0xc6,
+	0x5d, 0x29, 0x94, 0x83, 0x8b, 0x8b, 0xdd, 0x60, 0xda, 0xee, 0x5b, 0x80,
+	0x51, 0x4d, 0xbf, 0x3f, 0x0e, 0xc5, 0x72, 0xbb, 0xbb, 0x88, 0xd6, 0x68,
+	0xdc, 0xed, 0x54, 0x42, 0xf8, 0x83, 0xdd, 0xdc, 0xd1, 0x0f, 0x33, 0xda,
+	0x53, 0x6f, 0xcf, 0xa2, 0x9e, 0xa7, 0xe7, 0xec, 0xe1, 0x76, 0xfc, 0x51,
+	0xee, 0xee, 0xb9, 0x5d, 0xbe, 0x2d, 0x5e, 0x49, 0x58, 0x5e, 0xb0, 0x8a,
+	0x74, 0x8f, 0x0e, 0xfd, 0x8d, 0xdc, 0x98, 0x17, 0x1a, 0x3d, 0x99, 0x01,
+	0x04, 0x91, 0xd0, 0xd7, 0x62, 0xb1, 0xd3, 0x61, 0x69, 0x56, 0x92, 0x88,
+	0x3e, 0x79, 0x63, 0x1f, 0x57, 0x39, 0x09, 0x05, 0xea, 0xab, 0x82, 0xbd,
+	0x3c, 0x3b, 0xc7, 0x4c, 0x0a, 0x94, 0xa0, 0x4b, 0x89, 0xe5, 0x24, 0xcd,
+	0x16, 0x4a, 0x82, 0xe0, 0x22, 0x74, 0xfe, 0x5b, 0x04, 0x1b, 0x64, 0x2f,
+	0x55, 0xb6, 0xe6, 0xe9, 0x2e, 0x56, 0x8c, 0x9f, 0xd5, 0x48, 0xda, 0x34,
+	0x72, 0xca, 0x8a, 0x9e, 0xf5, 0x7a, 0x3c, 0x53, 0x24, 0xe6, 0x3d, 0x75,
+	0xfd, 0x2b, 0x47, 0x08, 0x0b, 0x9f, 0x13, 0x28, 0x52, 0x08, 0x51, 0xe2,
+	0x29, 0x46, 0x4e, 0xe9, 0x9d, 0xaa, 0x0d, 0xfb, 0x19, 0x97, 0x8e, 0xc9,
+	0x0c, 0xa0, 0xb9, 0x7f, 0x99, 0xab, 0x59, 0x68, 0x93, 0xd0, 0xf2, 0x4b,
+	0x96, 0x83, 0xfe, 0x19, 0xa5, 0x84, 0xe7, 0xd8, 0xac, 0x55, 0x3e, 0xec,
+	0xfe, 0x73, 0x84, 0xb7, 0xf7, 0x4d, 0x6d, 0x3e, 0x20, 0x7e, 0xb3, 0x8f,
+	0xdd, 0xb1, 0x7d, 0x6c, 0xc1, 0xd8, 0x5c, 0x5d, 0x57, 0x9b, 0x58, 0x2d,
+	0x95, 0xdf, 0x02, 0x2d, 0xe0, 0x89, 0xef, 0x02, 0xe9, 0xc6, 0xd6, 0xbc,
+	0x50, 0x88, 0x58, 0x08, 0x69, 0x5f, 0xcc, 0xb0, 0x7e, 0x6d, 0x29, 0x11,
+	0xdf, 0xf6, 0xff, 0x93, 0x58, 0x1f, 0x20, 0xa9, 0xdc, 0x2c, 0xfa, 0xdc,
+	0xbe, 0x4d, 0xf0, 0xba, 0x0b, 0xc7, 0x7b, 0x86, 0xfb, 0x59, 0x0f, 0xed,
+	0xc6, 0xe1, 0x15, 0x7a, 0x73, 0x41, 0xa0, 0xa5, 0x01, 0x44, 0xf5, 0x3b,
+	0x8e, 0x9e, 0x23, 0x82, 0xb5, 0x3b, 0x1d, 0x22, 0xf2, 0x78, 0xfa, 0xc1,
+	0x7a, 0x66, 0x08, 0xa1, 0xd0, 0x04, 0xfa, 0x53, 0x0d, 0xc9, 0x32, 0x5d,
+	0x78, 0xa6, 0x52, 0x69, 0x39, 0xe7, 0xa2, 0xec, 0x2b, 0x68, 0x3c, 0xad,
+	0xf8, 0x4f, 0xba, 0xb3, 0xd2, 0x41, 0x5e, 0x87, 0x98, 0x66, 0xb8, 0x7f,
+	0x44, 0x50, 0xbb, 0xf4, 0xfc, 0x93, 0xa9, 0xb6, 0xdd, 0x88, 0xf9, 0x9b,
+	0x26, 0x87, 0x33, 0x08, 0x67, 0x37, 0xf9, 0x32, 0x56, 0xcb, 0xb3, 0xba,
+	0x6e, 0x1e, 0xba, 0xa7, 0x3e, 0x14, 0xc0, 0x48, 0x3f, 0x95, 0x0b, 0x6e,
+	0xfb, 0x9c, 0xcd, 0x7d, 0xf9, 0x5a, 0xd9, 0xc3, 0x3f, 0xb6, 0x72, 0x4d,
+	0xd5, 0x8f, 0x23, 0xa2, 0x12, 0xf3, 0x66, 0x46, 0x42, 0x38, 0x3d, 0x29,
+	0x60, 0x0d, 0x59, 0x20, 0x78, 0xaf, 0x08, 0x24, 0xbc, 0xfa, 0x76, 0x85,
+	0x65, 0x10, 0xe9, 0x37, 0x58, 0x9d, 0x90, 0xef, 0x37, 0xb0, 0x0e, 0x8d,
+	0x72, 0x74, 0x4e, 0x4c, 0x4c, 0x7b, 0x99, 0x4e, 0x29, 0xc6, 0x4e, 0xc4,
+	0x54, 0xd0, 0x54, 0x9a, 0x0a, 0x0e, 0x6b, 0xdc, 0x04, 0x87, 0x4f, 0x26,
+	0x3d, 0x63, 0xcf, 0x1f, 0x92, 0x54, 0xa1, 0xec, 0xd9, 0x9f, 0x91, 0x6c,
+	0xd5, 0xcb, 0x7c, 0x40, 0x6f, 0x9b, 0x52, 0x30, 0x37, 0x54, 0xe7, 0xbb,
+	0x17, 0x4d, 0x41, 0x6e, 0x61, 0x1a, 0xf9, 0xbd, 0xa5, 0xd7, 0x81, 0xb4,
+	0xf8, 0x04, 0x99, 0xef, 0x7b, 0x8c, 0xc5, 0x56, 0xd0, 0xa4, 0x71, 0x5f,
+	0x9f, 0x29, 0x67, 0xbb, 0xdc, 0xcb, 0x4c, 0x2d, 0x24, 0x73, 0xab, 0xcd,
+	0x4b, 0x4e, 0xaf, 0xa1, 0x7c, 0xba, 0xd7, 0xf4, 0xb8, 0xd9, 0x1d, 0x29,
+	0x52, 0x71, 0x20, 0xdb, 0x09, 0x76, 0x4f, 0xf6, 0xe4, 0x37, 0x40, 0x4a,
+	0xb5, 0xbb, 0x20, 0xa2, 0x7d, 0x21, 0x89, 0x16, 0xf1, 0x67, 0x57, 0x90,
+	0x8b, 0xf5, 0x2f, 0x46, 0x6f, 0x93, 0xf4, 0xb8, 0xc0, 0xa3, 0x95, 0x2b,
+	0xb3, 0x6d, 0x49, 0x78, 0x42, 0x66, 0xa3, 0x30, 0x8e, 0x69, 0xd8, 0x47,
+	0x50, 0xcf, 0xe3, 0x17, 0x8b, 0xfb, 0x91, 0xde, 0xff, 0x4e, 0xa8, 0xbb,
+	0x6d, 0xac, 0xf4, 0xc6, 0x3b, 0x7a, 0x50, 0x2f, 0x88, 0x4f, 0x8c, 0xe4,
+	0x86, 0xc5, 0x1d, 0x5a, 0x5a, 0x1a, 0xb4, 0xad, 0x7f, 0x70, 0x66, 0x37,
+	0x94, 0x25, 0x1d, 0xd4, 0xdb, 0x09, 0xfc, 0xb7, 0x39, 0x7f, 0x2b, 0x6b,
+	0xfb, 0xac, 0xcc, 0x05, 0xe0, 0xe5, 0x87, 0x19, 0x8f, 0x27, 0x36, 0xb6,
+	0x3a, 0x65, 0x47, 0x79, 0x4b, 0x83, 0xc3, 0x73, 0x0d, 0x5c, 0x7b, 0x20,
+	0x3a, 0xa0, 0x7d, 0xc0, 0x03, 0x44, 0x8c, 0x56, 0x07, 0x2b, 0x44, 0x68,
+	0x9e, 0xd6, 0x92, 0x34, 0x4a, 0xf1, 0xc9, 0x7f, 0xaa, 0x1c, 0x7b, 0x49,
+	0x05, 0x79, 0x93, 0x1b, 0xd3, 0x32, 0x5f, 0x80, 0xca, 0xb7, 0x52, 0xcc,
+	0x75, 0xb6, 0x2d, 0x8a, 0x46, 0xac, 0x28, 0x2d, 0x53, 0xea, 0xf3, 0xd6,
+	0x7d, 0x11, 0x02, 0x12, 0x6e, 0x84, 0x8e, 0x96, 0x5a, 0x28, 0xce, 0xbc,
+	0x91, 0xe6, 0xb3, 0x7b, 0x85, 0xca, 0xb5, 0x88, 0x49, 0xb0, 0xd4, 0x86,
+	0x91, 0x02, 0x36, 0x8e, 0xc6, 0x69, 0x75, 0x66, 0x1d, 0xa7, 0x88, 0xc2,
+	0x31, 0xd9, 0x0a, 0x48, 0xfc, 0x40, 0x2e, 0xe7, 0x3c, 0x4b, 0x42, 0x4a,
+	0xa4, 0x91, 0xcf, 0xd1, 0x94, 0x93, 0xa9, 0x97, 0xad, 0xc3, 0x0c, 0xc5,
+	0x81, 0x5a, 0x62, 0xee, 0x80, 0x5d, 0xb5, 0x74, 0x89, 0x65, 0x4b, 0xbb,
+	0xc0, 0x8f, 0xa7, 0xfa, 0xa2, 0x93, 0x68, 0xd9, 0x32, 0x02, 0x12, 0xa7,
+	0xd9, 0xd1, 0x83, 0xd3, 0x81, 0xe7, 0xcd, 0x8b, 0x1e, 0xae, 0x3d, 0xec,
+	0x4a, 0x94, 0x40, 0x90, 0xef, 0x72, 0xcb, 0x76, 0xeb, 0xdd, 0xbe, 0x20,
+	0x86, 0x6d, 0x30, 0xfb, 0x5e, 0x3c, 0x76, 0x41, 0x93, 0x2d, 0x32, 0xa0,
+	0x3d, 0x93, 0x21, 0xed, 0x76, 0x8c, 0xe1, 0xee, 0x22, 0x42, 0x84, 0x90,
+	0x1a, 0xad, 0xca, 0x4e, 0xd0, 0x1a, 0x17, 0xea, 0xf2, 0x6e, 0x63, 0xe8,
+	0x11, 0x18, 0x65, 0x81, 0xc9, 0xf2, 0x64, 0xac, 0x61, 0x65, 0xa4, 0xbe,
+	0x4e, 0x29, 0x2c, 0xba, 0xbe, 0x59, 0xc5, 0x97, 0xb9, 0x04, 0x59, 0xf7,
+	0x7b, 0x0b, 0xcc, 0xb5, 0x27, 0xcf, 0x6e, 0x72, 0x30, 0xa2, 0xd9, 0x5e,
+	0xcc, 0x5c, 0xd3, 0x48, 0x20, 0x69, 0xbc, 0x5d, 0xb7, 0x22, 0xed, 0xbd,
+	0x45, 0xe4, 0xcc, 0xeb, 0xb3, 0x23, 0x7c, 0x98, 0x31, 0x51, 0x73, 0x8e,
+	0x90, 0x95, 0x44, 0xf4, 0x89, 0x65, 0x9a, 0xed, 0xd2, 0x43, 0x4c, 0x7d,
+	0x64, 0x0d, 0x49, 0x14, 0x6c, 0x6d, 0xac, 0x37, 0x5b, 0xd8, 0xd2, 0x11,
+	0x39, 0xc7, 0xc0, 0xd3, 0x70, 0xd6, 0xf0, 0xbc, 0x61, 0x86, 0x9d, 0x6b,
+	0xb6, 0xc0, 0x95, 0x1b, 0x47, 0x96, 0xd0, 0xc7, 0x7e, 0x7d, 0x08, 0x74,
+	0x33, 0x74, 0x32, 0x24, 0x24, 0xa9, 0xb5, 0x4b, 0x43, 0xa6, 0xa3, 0xe9,
+	0x7c, 0x98, 0x7b, 0x3b, 0xf1, 0x24, 0x0d, 0xf5, 0xbf, 0xb7, 0xf6, 0x9a,
+	0xcd, 0x0d, 0x6f, 0xc7, 0xa2, 0xe1, 0x95, 0xef, 0xb4, 0x50, 0xdc, 0x7e,
+	0xfc, 0xb2, 0x08, 0xa9, 0x96, 0xb9, 0x99, 0x9d, 0x11, 0xbc, 0xb4, 0x8f,
+	0xcc, 0x6e, 0x72, 0xaf, 0xaf, 0x70, 0x77, 0x4f, 0xb9, 0x1c, 0x81, 0x11,
+	0xed, 0xf0, 0x9d, 0x13, 0x52, 0x56, 0x3d, 0x94, 0xe9, 0x87, 0x33, 0x06,
+	0xe5, 0xa2, 0xdd, 0x00, 0xf9, 0x2f, 0xf7, 0x6f, 0xb8, 0x15, 0x11, 0x8b,
+	0x82, 0x2e, 0x7b, 0x3a, 0xee, 0x2d, 0x4e, 0x27, 0x90, 0x8a, 0xfc, 0x1c,
+	0x78, 0x17, 0x13, 0xc8, 0x2d, 0xb5, 0x99, 0xfe, 0x18, 0x87, 0xf0, 0x76,
+	0xaa, 0xf4, 0xfd, 0x40, 0x5a, 0xdf, 0x80, 0xd5, 0xd0, 0x18, 0x88, 0x57,
+	0x3d, 0xe1, 0xf4, 0xd3, 0x7c, 0xbf, 0xe1, 0xb8, 0x99, 0x16, 0x3a, 0x90,
+	0x67, 0xcc, 0x17, 0x47, 0xe0, 0x28, 0xea, 0x6f, 0x7c, 0xea, 0x24, 0x79,
+	0x7d, 0x4b, 0x8a, 0x7f, 0x65, 0xaf, 0xed, 0x9b, 0xa1, 0xf3, 0x91, 0xd6,
+	0x8e, 0xca, 0xed, 0xfc, 0x8f, 0x6d, 0x40, 0x18, 0x19, 0x28, 0x56, 0x09,
+	0x09, 0x0f, 0x39, 0xf9, 0x27, 0x93, 0xd8, 0xf3, 0x76, 0x0d, 0x69, 0x48,
+	0x17, 0xf5, 0x61, 0x41, 0x05, 0xe3, 0x66, 0x7d, 0xe5, 0x63, 0xe0, 0xdb,
+	0x33, 0x7a, 0x41, 0x93, 0xa1, 0xf6, 0xdc, 0x60, 0x82, 0xac, 0x21, 0xe8,
+	0xb1, 0x11, 0x48, 0xba, 0x30, 0x9b, 0x20, 0x1c, 0xa4, 0xe9, 0x8f, 0x6d,
+	0xe6, 0xba, 0x52, 0x49, 0xd3, 0x0c, 0xac, 0xc5, 0x5b, 0x4f, 0x33, 0x7c,
+	0xfa, 0x02, 0xb0, 0xb3, 0xcd, 0xd5, 0xae, 0xd2, 0x12, 0x56, 0xc0, 0xb4,
+	0x94, 0x3d, 0x1c, 0x3f, 0xac, 0x3f, 0xb6, 0xfe, 0xeb, 0xca, 0x8f, 0x23,
+	0x15, 0xc1, 0x9f, 0xba, 0xc7, 0x74, 0x61, 0xaa, 0x77, 0x65, 0xf6, 0x60,
+	0xca, 0x8f, 0xf6, 0x30, 0xca, 0x1e, 0x84, 0x31, 0x60, 0x1e, 0x49, 0xbb,
+	0x9f, 0x7b, 0xe8, 0x22, 0x0b, 0x2d, 0xf6, 0x58, 0x02, 0xe5, 0xe1, 0x9c,
+	0x03, 0x4d, 0x70, 0x9d, 0xfa, 0xef, 0x43, 0x07, 0xfe, 0x76, 0xc9, 0xf3,
+	0x80, 0x54, 0xe1, 0x1c, 0x6d, 0xee, 0x98, 0x06, 0x42, 0xa0, 0xd6, 0x5a,
+	0x7b, 0x37, 0x3a, 0x14, 0x8d, 0xae, 0xc9, 0x67, 0x59, 0x58, 0x96, 0x08,
+	0x99, 0x43, 0x05, 0xa7, 0x47, 0x17, 0x77, 0x86, 0x97, 0x24, 0x22, 0xa6,
+	0x3e, 0xf1, 0x86, 0x4d, 0xf9, 0x69, 0xe0, 0xdd, 0x1d, 0x46, 0x8a, 0xbc,
+	0xc6, 0x7f, 0xe6, 0x98, 0x65, 0xab, 0x78, 0x4f, 0x0e, 0xbf, 0x14, 0x9f,
+	0x60, 0x9e, 0x24, 0xe0, 0x81, 0x3b, 0xde, 0xbc, 0xcb, 0xc9, 0x9c, 0x44,
+	0xf1, 0x23, 0xaa, 0xd7, 0x3b, 0xf9, 0x66, 0xb0, 0x9e, 0xb9, 0xab, 0x70,
+	0x0c, 0x9c, 0xca, 0xc1, 0x0c, 0x56, 0x2d, 0xe9, 0xe9, 0xd4, 0x82, 0xb1,
+	0x18, 0x5e, 0x95, 0x97, 0x03, 0x45, 0x68, 0x1f, 0x8e, 0xa6, 0x5e, 0xe4,
+	0x7c, 0xe2, 0xdc, 0x9c, 0x9c, 0x3b, 0x74, 0xbb, 0xed, 0x62, 0x59, 0xce,
+	0x25, 0x1b, 0xb0, 0x0e, 0x86, 0x20, 0xf4, 0xc1, 0xed, 0x06, 0xfb, 0x3f,
+	0xbb, 0x32, 0x49, 0x5c, 0xfd, 0x49, 0xda, 0xe7, 0x2a, 0xad, 0xb7, 0x9b,
+	0xa0, 0x6d, 0x17, 0xba, 0x2a, 0x67, 0x42, 0xdb, 0x31, 0x8d, 0x9a, 0x2b,
+	0x3e, 0x6d, 0x6f, 0x5e, 0x4c, 0x19, 0x42, 0xc3, 0x23, 0x4d, 0x63, 0x47,
+	0xd1, 0xa2, 0x35, 0x99, 0xe2, 0x66, 0x9f, 0x38, 0xa8, 0xb2, 0xd1, 0xc9,
+	0x46, 0xa1, 0xd4, 0xe9, 0xe9, 0xb0, 0xdc, 0x0d, 0x46, 0xda, 0xb5, 0x7f,
+	0x67, 0xd0, 0x03, 0xd3, 0xad, 0x7c, 0x3f, 0x32, 0x3c, 0xb3, 0x56, 0x30,
+	0xe4, 0x4e, 0xb4, 0xd5, 0xd7, 0xa1, 0x8d, 0x0c, 0x6e, 0xb3, 0xe7, 0x1a,
+	0xfe, 0xba, 0x1c, 0x89, 0x06, 0x78, 0xa2, 0x5c, 0x77, 0x0d, 0x55, 0x76,
+	0x3e, 0x3f, 0x18, 0x28, 0x85, 0x46, 0xc0, 0xae, 0xb3, 0xfb, 0xbb, 0x25,
+	0x5b, 0xb6, 0xc7, 0x5c, 0xe5, 0xe3, 0x39, 0x2c, 0x01, 0x83, 0xa6, 0xb1,
+	0x8a, 0xbf, 0xaf, 0x35, 0x9c, 0x3f, 0xdc, 0xe0, 0xea, 0xa2, 0x31, 0x4d,
+	0x3c, 0x04, 0x5b, 0xeb, 0x06, 0x40, 0xed, 0xa2, 0x30, 0xd0, 0x00, 0xbe,
+	0x26, 0xe8, 0x0b, 0x12, 0x1f, 0x00, 0x00, 0x02, 0xab, 0x2c, 0xb2, 0x7e,
+	0x46, 0xc0, 0x82, 0xfa, 0xa1, 0x3a, 0x54, 0x68, 0x9d, 0x9c, 0x83, 0x10,
+	0x8a, 0x94, 0xde, 0x94, 0xd4, 0x4d, 0xc6, 0x6d, 0x75, 0xbd, 0xbf, 0x0e,
+	0x40, 0x5a, 0xf9, 0xfc, 0xc7, 0x0d, 0xc3, 0xd4, 0xea, 0xb7, 0x82, 0x5e,
+	0x0b, 0xbe, 0x93, 0xf2, 0x2a, 0x8c, 0x01, 0xbc, 0xb3, 0xb5, 0x3a, 0x2d,
+	0xf8, 0x7e, 0xad, 0x3b, 0x24, 0x11, 0xf0, 0x6c, 0x62, 0x55, 0x46, 0x24,
+	0x62, 0xf3, 0x01, 0xfb, 0x3f, 0xc2, 0x00, 0x79, 0x93, 0xca, 0x01, 0x69,
+	0x54, 0xf0, 0xba, 0xa1, 0x99, 0x3f, 0x9c, 0xbb, 0x45, 0xb1, 0x5e, 0xab,
+	0xee, 0xa8, 0xe6, 0x4d, 0x84, 0xb2, 0x84, 0xfb, 0x5f, 0x3e, 0xe7, 0x29,
+	0xeb, 0xba, 0x47, 0x96, 0xd6, 0xab, 0x61, 0x4b, 0x7e, 0x25, 0x36, 0x8c,
+	0xb1, 0x0e, 0xf7, 0x18, 0xc9, 0x77, 0xb1, 0x92, 0x5f, 0xb3, 0x47, 0x02,
+	0xd3, 0x1b, 0x7e, 0x1d, 0x56, 0x14, 0x40, 0xc7, 0xf8, 0x9e, 0x30, 0xbe,
+	0xf3, 0xee, 0x8d, 0x85, 0x81, 0x3c, 0x7d, 0xfc, 0x25, 0x41, 0xc7, 0x37,
+	0x1f, 0x2a, 0xb2, 0xe5, 0xe0, 0x6b, 0x72, 0x94, 0xdc, 0xca, 0xed, 0xba,
+	0x8d, 0x89, 0x07, 0xac, 0x4f, 0xe0, 0xf0, 0x8e, 0x03, 0xcd, 0xc1, 0x0e,
+	0x13, 0xa5, 0x84, 0xf1, 0x26, 0x15, 0xca, 0xdc, 0x5c, 0xc1, 0xf4, 0xa0,
+	0x4e, 0xa6, 0x50, 0xbb, 0x17, 0x07, 0x4e, 0x01, 0x5b, 0x6e, 0x2c, 0x2a,
+	0x40, 0x06, 0x2c, 0x2c, 0x9b, 0xad, 0x37, 0xb5, 0x8e, 0x77, 0x5a, 0x44,
+	0x15, 0xd3, 0x66, 0xf2, 0x3d, 0x5f, 0x3c, 0xec, 0xb8, 0x1d, 0x45, 0xfd,
+	0x10, 0x84, 0xcd, 0xde, 0xe1, 0xee, 0x84, 0xb6, 0xbe, 0x16, 0x75, 0x20,
+	0xf3, 0x3a, 0x0f, 0x65, 0x97, 0xcc, 0xfc, 0x69, 0x53, 0xaa, 0x67, 0x9b,
+	0x44, 0xf4, 0xd9, 0xde, 0xc5, 0x59, 0x70, 0x05, 0x48, 0xbe, 0x64, 0x4a,
+	0xdd, 0x6e, 0xc7, 0xa4, 0xee, 0xbb, 0x0c, 0x33, 0x78, 0xc8, 0x86, 0xa7,
+	0x52, 0x99, 0x0a, 0xbc, 0xa5, 0xa9, 0xda, 0x31, 0xdd, 0xd6, 0x2c, 0xc9,
+	0xd2, 0x7f, 0x63, 0x13, 0x36, 0x83, 0x29, 0x20, 0xe6, 0x0e, 0xcb, 0x71,
+	0x84, 0xd1, 0xfd, 0x1e, 0x84, 0x59, 0x10, 0x95, 0x4c, 0x8b, 0xd9, 0xc4,
+	0x1e, 0xd7, 0x34, 0x8f, 0x68, 0x37, 0x29, 0x94, 0x0d, 0x95, 0x66, 0x14,
+	0xf6, 0x36, 0xc2, 0x3d, 0x6c, 0x17, 0x7e, 0x68, 0xb6, 0x39, 0x54, 0x89,
+	0x10, 0x40, 0x32, 0x8a, 0x8f, 0x35, 0xb5, 0xd1, 0xd3, 0xb9, 0x6c, 0xc7,
+	0x9a, 0x80, 0x0c, 0xc4, 0x47, 0xf8, 0x66, 0xca, 0x32, 0x6d, 0x57, 0xcf,
+	0x14, 0x13, 0x9b, 0xe7, 0xed, 0x4a, 0xc7, 0xc2, 0xdf, 0xda, 0x94, 0xe4,
+	0x3d, 0x02, 0x00, 0xba, 0x77, 0xdc, 0xa3, 0xf8, 0xa7, 0x83, 0xe1, 0x78,
+	0x93, 0xfe, 0xf1, 0x88, 0x80, 0x26, 0x0d, 0x0f, 0x10, 0x16, 0x4e, 0x51,
+	0x57, 0xf4, 0x08, 0x41, 0xbb, 0xfa, 0x5a, 0x24, 0x46, 0x59, 0x6f, 0xcf,
+	0xc0, 0xfe, 0x05, 0x8f, 0x93, 0x52, 0xb3, 0xcb, 0x5a, 0x4b, 0x6a, 0x16,
+	0x83, 0x86, 0x7f, 0x51, 0xf7, 0xfa, 0xd9, 0xf5, 0xe5, 0xa0, 0xe6, 0xd7,
+	0x60, 0xa7, 0x39, 0xb4, 0xc8, 0x0a, 0x42, 0xfa, 0x85, 0x76, 0xc5, 0x70,
+	0x05, 0xe4, 0xb9, 0x7e, 0x06, 0x79, 0x61, 0x68, 0x36, 0x67, 0x33, 0x9a,
+	0x2c, 0x86, 0xa8, 0x09, 0x3f, 0xfa, 0x3d, 0x45, 0xb2, 0x8b, 0x23, 0x0b,
+	0x84, 0x36, 0xf9, 0x78, 0x0e, 0x86, 0xb5, 0x1e, 0x19, 0xeb, 0x84, 0x67,
+	0xda, 0xdf, 0x45, 0x44, 0x73, 0x60, 0xa0, 0x27, 0xc4, 0x4b, 0x96, 0xfe,
+	0x8c, 0xac, 0x50, 0x65, 0xe3, 0x49, 0xe6, 0x5e, 0xb3, 0x05, 0x54, 0xe2,
+	0xd1, 0x5f, 0x4f, 0x99, 0x67, 0x04, 0x87, 0x9e, 0x43, 0xb2, 0x8b, 0xfd,
+	0xcc, 0x54, 0x45, 0x06, 0x81, 0xc9, 0x46, 0x2d, 0x55, 0x3b, 0x7b, 0x79,
+	0xad, 0x92, 0x79, 0x05, 0xd1, 0x67, 0x10, 0xc2, 0x6b, 0xb3, 0xf8, 0xa9,
+	0xd5, 0x80, 0x19, 0x99, 0x95, 0xfc, 0x79, 0x85, 0xa0, 0x24, 0x94, 0xbb,
+	0x0d, 0x7d, 0x4a, 0x65, 0x73, 0x76, 0x31, 0x2e, 0x31, 0x2e, 0x30, 0x00,
+	0x4c, 0x9b, 0x36, 0x07, 0xac, 0x2a, 0xbb, 0xe6, 0x0d, 0x47, 0x9b, 0xd0,
+	0x78, 0xbb, 0xc0, 0xf3, 0x92, 0xc4, 0xdb, 0x48, 0x00, 0x61, 0x08, 0x0c,
+	0x1d, 0x01, 0x62, 0xd3, 0x10, 0x90, 0x4e, 0x35, 0xb5, 0x7d, 0x90, 0x5f,
+	0x66, 0x08, 0xf0, 0x1b, 0x3d, 0x01, 0x75, 0x39, 0x50, 0x1b, 0x7e, 0x30,
+	0x3c, 0x7b, 0x07, 0x0c, 0xe2, 0x67, 0x28, 0xf1, 0xc3, 0xfb, 0x88, 0x85,
+	0xd6, 0x58, 0x04, 0xcb, 0xff, 0xb9, 0x83, 0xed, 0x85, 0xc8, 0xd1, 0x90,
+	0x99, 0x83, 0xb9, 0x6d, 0xec, 0x66, 0x00, 0x65, 0xba, 0xc4, 0xe6, 0x8e,
+	0xcf, 0x6c, 0x26, 0x6d, 0xe2, 0xe4, 0x02, 0xd6, 0x34, 0x18, 0xe8, 0x25,
+	0xc7, 0xa2, 0x6f, 0xaa, 0x13, 0xab, 0x44, 0xe0, 0x0a, 0x9f, 0xbc, 0xa6,
+	0x02, 0xeb, 0x0b, 0xa8, 0x6a, 0x70, 0x01, 0x85, 0x8a, 0x66, 0xe0, 0xd0,
+	0x60, 0xbc, 0x16, 0x64, 0xb8, 0xea, 0xc4, 0x70, 0xa7, 0xb4, 0x80, 0xfa,
+	0x4a, 0xf3, 0x7c, 0xf1, 0xdd, 0x62, 0x0d, 0xb7, 0x5a, 0x75, 0x1a, 0xa3,
+	0xf5, 0xde, 0xd8, 0x5c, 0xcd, 0x49, 0x65, 0x4d, 0x6a, 0xef, 0xd5, 0x96,
+	0x96, 0xcb, 0x5c, 0x53, 0xde, 0x7b, 0x31, 0x02, 0x52, 0xb7, 0x8a, 0x0d,
+	0xc0, 0x7c, 0xe5, 0x12, 0xe9, 0xd7, 0x02, 0xd3, 0xdd, 0x97, 0xe1, 0xcd,
+	0x6c, 0x0d, 0x03, 0xc7, 0x7f, 0x8b, 0x48, 0x14, 0xab, 0xc2, 0x88, 0xfb,
+	0x23, 0xd3, 0xc1, 0x3b, 0x71, 0x7e, 0xbe, 0x0a, 0x2f, 0x4b, 0x0f, 0x13,
+	0x18, 0xe4, 0x31, 0x90, 0x00, 0x8b, 0xfa, 0x6b, 0xb2, 0x04, 0x2e, 0x86,
+	0x3b, 0x45, 0x7a, 0xaf, 0xc6, 0x9c, 0x85, 0xd7, 0xdb, 0x4f, 0x03, 0x3c,
+	0xd9, 0x29, 0xad, 0xa9, 0xf7, 0x96, 0xbd, 0xc6, 0x69, 0x0d, 0x23, 0xc4,
+	0xb9, 0x19, 0x32, 0xa7, 0x27, 0x13, 0x7c, 0x36, 0x7c, 0xf3, 0xb9, 0x28,
+	0xdd, 0xd7, 0x60, 0x35, 0xbf, 0xfb, 0x4b, 0xea, 0x2a, 0x30, 0x1c, 0xb1,
+	0xef, 0xd1, 0x5b, 0x52, 0x1f, 0x79, 0xe8, 0xd3, 0x23, 0xbb, 0x7f, 0x61,
+	0x4b, 0x53, 0x08, 0x5a, 0xf4, 0x54, 0xdd, 0x0d, 0x75, 0xb0, 0xc8, 0xb6,
+	0xf4, 0xef, 0x45, 0x5e, 0xb7, 0x8f, 0xe2, 0xb5, 0xaf, 0x0e, 0x0f, 0x64,
+	0x36, 0x48, 0x8a, 0xbb, 0xcd, 0xbf, 0xac, 0x2a, 0x44, 0x86, 0x8c, 0x8f,
+	0x9f, 0x22, 0xfd, 0xd6, 0xdf, 0xb1, 0xfb, 0xe4, 0xd2, 0xeb, 0x17, 0x2b,
+	0x4e, 0x4c, 0xb4, 0x73, 0xfe, 0xb7, 0xf2, 0xe3, 0xa0, 0xd6, 0xce, 0xa3,
+	0xa9, 0x71, 0x32, 0x10, 0xf6, 0xb2, 0x9e, 0xec, 0x98, 0xf5, 0xb5, 0x84,
+	0xf6, 0xea, 0xe9, 0x42, 0xab, 0x98, 0xf4, 0xd1, 0xe5, 0x2d, 0x43, 0x8a,
+	0xeb, 0x96, 0x15, 0x38, 0x63, 0x46, 0x9c, 0x79, 0x1c, 0x6f, 0xcd, 0x95,
+};
+
+static const uint8_t patch_bin[] = {
+	0x44, 0x50, 0x54, 0x31, 0x00, 0x0c, 0x00, 0x00, 0x6c, 0x0c, 0x00, 0x00,
+	0x9a, 0x99, 0x89, 0x7b, 0x38, 0xbd, 0x35, 0x86, 0xb7, 0x40, 0xdb, 0xf6,
+	0x64, 0xbb, 0xcf, 0x54, 0x1f, 0x2a, 0xa7, 0xeb, 0x1b, 0x3e, 0x52, 0x50,
+	0xd7, 0x96, 0xe7, 0xff, 0x96, 0x1c, 0x0b, 0xd1, 0xb5, 0x1b, 0x10, 0x93,
+	0x16, 0x4e, 0x3c, 0xa1, 0x72, 0x61, 0x98, 0x2b, 0x0b, 0x11, 0x90, 0x67,
+	0x0a, 0x14, 0xe4, 0x57, 0x5e, 0x1d, 0x02, 0x9b, 0x54, 0xff, 0xde, 0x4d,
+	0xac, 0xc5, 0x02, 0xe8, 0x01, 0x00, 0x00, 0x00, 0x00, 0xf4, 0x01, 0x00,
+	0x00, 0x02, 0x14, 0x00, 0x00, 0x00, 0x15, 0x4a, 0x38, 0xf0, 0xbe, 0xb6,
+	0x4a, 0xa6, 0xd2, 0x78, 0xf1, 0x60, 0xf3, 0x5d, 0x56, 0xaf, 0x64, 0x83,
+	0x12, 0x94, 0x01, 0x08, 0x02, 0x00, 0x00, 0xda, 0x02, 0x00, 0x00, 0x02,
+	0xc9, 0x00, 0x00, 0x00, 0x20, 0xdb, 0x09, 0x76, 0x4f, 0xf6, 0xe4, 0x37,
+	0x40, 0x4a, 0xb5, 0xbb, 0x20, 0xa2, 0x7d, 0x21, 0x89, 0x16, 0xf1, 0x67,
+	0x57, 0x90, 0x8b, 0xf5, 0x2f, 0x46, 0x6f, 0x93, 0xf4, 0xb8, 0xc0, 0xa3,
+	0x95, 0x2b, 0xb3, 0x6d, 0x49, 0x78, 0x42, 0x66, 0xa3, 0x30, 0x8e, 0x69,
+	0xd8, 0x47, 0x50, 0xcf, 0xe3, 0x17, 0x8b, 0xfb, 0x91, 0xde, 0xff, 0x4e,
+	0xa8, 0xbb, 0x6d, 0xac, 0xf4, 0xc6, 0x3b, 0x7a, 0x50, 0x2f, 0x88, 0x4f,
+	0x8c, 0xe4, 0x86, 0xc5, 0x1d, 0x5a, 0x5a, 0x1a, 0xb4, 0xad, 0x7f, 0x70,
+	0x66, 0x37, 0x94, 0x25, 0x1d, 0xd4, 0xdb, 0x09, 0xfc, 0xb7, 0x39, 0x7f,
+	0x2b, 0x6b, 0xfb, 0xac, 0xcc, 0x05, 0xe0, 0xe5, 0x87, 0x19, 0x8f, 0x27,
+	0x36, 0xb6, 0x3a, 0x65, 0x47, 0x79, 0x4b, 0x83, 0xc3, 0x73, 0x0d, 0x5c,
+	0x7b, 0x20, 0x3a, 0xa0, 0x7d, 0xc0, 0x03, 0x44, 0x8c, 0x56, 0x07, 0x2b,
+	0x44, 0x68, 0x9e, 0xd6, 0x92, 0x34, 0x4a, 0xf1, 0xc9, 0x7f, 0xaa, 0x1c,
+	0x7b, 0x49, 0x05, 0x79, 0x93, 0x1b, 0xd3, 0x32, 0x5f, 0x80, 0xca, 0xb7,
+	0x52, 0xcc, 0x75, 0xb6, 0x2d, 0x8a, 0x46, 0xac, 0x28, 0x2d, 0x53, 0xea,
+	0xf3, 0xd6, 0x7d, 0x11, 0x02, 0x12, 0x6e, 0x84, 0x8e, 0x96, 0x5a, 0x28,
+	0xce, 0xbc, 0x91, 0xe6, 0xb3, 0x7b, 0x85, 0xca, 0xb5, 0x88, 0x49, 0xb0,
+	0xd4, 0x86, 0x91, 0x02, 0x36, 0x8e, 0xc6, 0x69, 0x75, 0x66, 0x1d, 0xa7,
+	0x88, 0x01, 0xd0, 0x07, 0x00, 0x00, 0x58, 0x02, 0x00, 0x00, 0x01, 0xe2,
+	0x04, 0x00, 0x00, 0xee, 0x02, 0x00, 0x00, 0x02, 0x07, 0x00, 0x00, 0x00,
+	0x76, 0x31, 0x2e, 0x31, 0x2e, 0x30, 0x00, 0x01, 0x8c, 0x0a, 0x00, 0x00,
+	0x74, 0x01, 0x00, 0x00, 0x00,
+};
+
+#endif
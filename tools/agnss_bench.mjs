@@ -0,0 +1,271 @@
+// Latency and throughput benchmark for lambda/agnss.mjs.
+//
+// Runs the real handler against local stubs for SSM, nRF Cloud (serving a
+// recorded A-GNSS blob with Range support) and IoT Data Plane, see
+// lib/stubs.mjs.
+//
+// Needs `npm install` in both tools/ and lambda/ (AWS_ENDPOINT_URL
+// support needs AWS SDK v3.490 or later).
+//
+//   node agnss_bench.mjs --blob recorded.bin --iterations 200
+//
+// Options:
+//   --blob PATH|N          Recorded A-GNSS response, or N random bytes (3800)
+//   --chunk-size N         chunk_size sent by the "device" (1600)
+//   --mask N               A-GNSS type mask sent by the "device" (8191)
+//   --cloud-latency MS     Added to every nRF Cloud response (50)
+//   --iterations N         Warm invocations (100)
+//   --concurrency N        Warm invocations in flight at once (1)
+//   --cold N               Cold starts, each in a fresh node process (5)
+//   --verbose              Keep the handler's own logging
+//
+// Every invocation is checked: the published chunks must add up to the
+// blob, in order, and all of them must be published before the handler
+// calls back. With --concurrency above 1 chunks cannot be attributed to an
+// invocation, so only the totals are checked.
+import { spawn } from 'node:child_process';
+import { fileURLToPath } from 'node:url';
+import { parseArgs } from 'node:util';
+
+import { start_stubs, redirect_to_stubs } from './lib/stubs.mjs';
+import { Samples, print_summaries } from './lib/metrics.mjs';
+
+const LAMBDA = '../lambda/agnss.mjs';
+const AGNSS_RESPONSE_TOPIC = 'nrfcloud/agps';
+
+const { values: args } = parseArgs({
+    options: {
+        blob: { type: 'string', default: '3800' },
+        'chunk-size': { type: 'string', default: '1600' },
+        mask: { type: 'string', default: '8191' },
+        'cloud-latency': { type: 'string', default: '50' },
+        iterations: { type: 'string', default: '100' },
+        concurrency: { type: 'string', default: '1' },
+        cold: { type: 'string', default: '5' },
+        verbose: { type: 'boolean', default: false },
+        // Internal, set for the cold start child processes
+        'child-port': { type: 'string' },
+    },
+});
+
+const print = console.log;
+if (!args.verbose) {
+    console.log = () => {};
+}
+
+// Same fields as json_agnss_req_construct()
+const event = {
+    mcc: 310, mnc: 410, tac: 1000, eci: 80000000,
+    rsrp: -95, filtered: true,
+    mask: Number(args.mask),
+    chunk_size: Number(args['chunk-size']),
+};
+
+/**
+ * Call the handler, resolving with its result and completion time
+ */
+function invoke(handler) {
+    return new Promise((resolve, reject) => {
+        handler({ ...event }, {}, (err, result) => {
+            const done = performance.now();
+            if (err) {
+                reject(err);
+            } else {
+                resolve({ result, done });
+            }
+        });
+    });
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Cold start child: import the Lambda, invoke it once and report timings
+
+if (args['child-port']) {
+    redirect_to_stubs(Number(args['child-port']));
+
+    const start = performance.now();
+    const { handler } = await import(LAMBDA);
+    const imported = performance.now();
+    const { done } = await invoke(handler);
+
+    process.stdout.write(JSON.stringify({
+        boot_ms: start,
+        import_ms: imported - start,
+        first_ms: done - imported,
+        max_rss_kb: process.resourceUsage().maxRSS,
+    }));
+    process.exit(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Stubs, publishes are logged with their arrival time
+
+let published = [];
+
+const stubs = await start_stubs({
+    agnss_blob: /^\d+$/.test(args.blob) ? Number(args.blob) : args.blob,
+    cloud_latency_ms: Number(args['cloud-latency']),
+}, (topic, payload) => {
+    published.push({ topic, payload, at: performance.now() });
+});
+redirect_to_stubs(stubs.port);
+
+const expected_chunks = Math.ceil(stubs.blob.length /
+    Math.min(Math.max(event.chunk_size, 256), 65536));
+
+print(`Blob ${stubs.blob.length} bytes, chunk_size ${event.chunk_size} ` +
+      `(${expected_chunks} chunks), nRF Cloud latency ${args['cloud-latency']} ms`);
+
+//////////////////////////////////////////////////////////////////////////////
+// Cold starts
+
+const cold = {
+    node_boot: new Samples(),
+    module_import: new Samples(),
+    first_invocation: new Samples(),
+};
+const cold_rss = new Samples();
+
+for (let i = 0; i < Number(args.cold); i++) {
+    const child = spawn(process.execPath, [
+        fileURLToPath(import.meta.url), '--child-port', String(stubs.port),
+        '--chunk-size', args['chunk-size'], '--mask', args.mask,
+    ], { stdio: [ 'ignore', 'pipe', 'inherit' ] });
+
+    let out = '';
+    child.stdout.on('data', (data) => { out += data; });
+    const code = await new Promise((resolve) => child.on('close', resolve));
+    if (code !== 0) {
+        print(`Cold start ${i} failed with exit code ${code}`);
+        process.exit(1);
+    }
+
+    const r = JSON.parse(out);
+    cold.node_boot.add(r.boot_ms);
+    cold.module_import.add(r.import_ms);
+    cold.first_invocation.add(r.first_ms);
+    cold_rss.add(r.max_rss_kb / 1024);
+}
+published = [];
+
+//////////////////////////////////////////////////////////////////////////////
+// Warm invocations
+
+const { handler } = await import(LAMBDA);
+
+const warm = {
+    total: new Samples(),
+};
+for (let i = 0; i < expected_chunks; i++) {
+    warm[`publish_chunk_${i}`] = new Samples();
+}
+const failures = [];
+
+/**
+ * Check the publishes of a single invocation that completed at done
+ */
+function check_invocation(start, done, result) {
+    const chunks = published;
+    published = [];
+
+    if (result.err) {
+        failures.push(`nRF Cloud error: ${result.err}`);
+        return;
+    }
+    if (chunks.length !== expected_chunks) {
+        failures.push(`${chunks.length} chunks published, expected ${expected_chunks}`);
+    }
+    chunks.forEach((chunk, i) => {
+        if (chunk.topic !== AGNSS_RESPONSE_TOPIC) {
+            failures.push(`chunk ${i} published to ${chunk.topic}`);
+        }
+        if (chunk.at > done) {
+            failures.push(`chunk ${i} published ${(chunk.at - done).toFixed(1)} ms after completion`);
+        }
+        if (warm[`publish_chunk_${i}`]) {
+            warm[`publish_chunk_${i}`].add(chunk.at - start);
+        }
+    });
+    if (!Buffer.concat(chunks.map((c) => c.payload)).equals(stubs.blob)) {
+        failures.push('published chunks do not reassemble the blob');
+    }
+    if (result.agps !== stubs.blob.toString('base64')) {
+        failures.push('handler result does not match the blob');
+    }
+}
+
+const iterations = Number(args.iterations);
+const concurrency = Math.max(1, Number(args.concurrency));
+const heap_before = process.memoryUsage().heapUsed;
+const run_start = performance.now();
+let started = 0;
+
+async function worker() {
+    while (started < iterations) {
+        started++;
+        const start = performance.now();
+        let outcome;
+        try {
+            outcome = await invoke(handler);
+        } catch (err) {
+            failures.push(`handler error: ${err.message || err}`);
+            published = [];
+            continue;
+        }
+        warm.total.add(outcome.done - start);
+        if (concurrency === 1) {
+            check_invocation(start, outcome.done, outcome.result);
+        }
+    }
+}
+
+await Promise.all(Array.from({ length: concurrency }, worker));
+const elapsed_s = (performance.now() - run_start) / 1000;
+
+if (concurrency > 1) {
+    // Every handler has called back, so every chunk must be here already
+    const bytes = published.reduce((n, c) => n + c.payload.length, 0);
+    if (published.length !== iterations * expected_chunks) {
+        failures.push(`${published.length} chunks published, expected ${iterations * expected_chunks}`);
+    }
+    if (bytes !== iterations * stubs.blob.length) {
+        failures.push(`${bytes} bytes published, expected ${iterations * stubs.blob.length}`);
+    }
+}
+
+if (global.gc) {
+    global.gc();
+}
+const memory = process.memoryUsage();
+await stubs.close();
+
+//////////////////////////////////////////////////////////////////////////////
+// Report
+
+console.log = print;
+
+print_summaries(`Cold start (${args.cold} processes)`, cold);
+print_summaries('Cold start memory', { max_rss: cold_rss }, 'MB');
+print_summaries(`Warm (${iterations} invocations, concurrency ${concurrency})`, warm);
+
+print('\nThroughput');
+print(`  invocations/s          ${(iterations / elapsed_s).toFixed(1)}`);
+print(`  published bytes/s      ${(iterations * stubs.blob.length / elapsed_s).toFixed(0)}`);
+print(`  nRF Cloud requests     ${stubs.stats.agnss}`);
+
+print('\nMemory after warm runs');
+print(`  rss                    ${(memory.rss / 1048576).toFixed(1)} MB`);
+print(`  heap used              ${(memory.heapUsed / 1048576).toFixed(1)} MB`);
+print(`  heap growth            ${((memory.heapUsed - heap_before) / 1048576).toFixed(1)} MB` +
+      (global.gc ? '' : ' (run with --expose-gc for a settled value)'));
+print(`  max rss                ${(process.resourceUsage().maxRSS / 1024).toFixed(1)} MB`);
+
+if (failures.length) {
+    print(`\n${failures.length} check failures, first ones:`);
+    for (const failure of failures.slice(0, 10)) {
+        print(`  ${failure}`);
+    }
+    process.exit(1);
+}
+print('\nAll chunks published in order before the handler completed');
+process.exit(0);
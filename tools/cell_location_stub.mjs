@@ -0,0 +1,71 @@
+// Local stand-in for lambda/cell_location.mjs. Answers the device's
+// location/<device>/req messages on a local MQTT broker from a table of
+// known cells, so the cellular fallback can be tested without nRF Cloud.
+//
+//   node cell_location_stub.mjs [--broker mqtt://localhost:1883]
+//       [--cells cells.json] [--default 47.0,8.0,500] [--delay 200]
+//
+// cells.json maps "mcc/mnc/eci" to { "lat": .., "lon": .., "uncertainty": .. }.
+// Unknown cells get the --default fix, or an error response without one.
+import { readFileSync } from 'node:fs';
+import { parseArgs } from 'node:util';
+import mqtt from 'mqtt';
+
+const { values: args } = parseArgs({
+    options: {
+        broker: { type: 'string', default: 'mqtt://localhost:1883' },
+        cells: { type: 'string' },
+        default: { type: 'string' },
+        delay: { type: 'string', default: '0' },
+    },
+});
+
+const cells = args.cells ? JSON.parse(readFileSync(args.cells, 'utf8')) : {};
+let default_fix = null;
+if (args.default) {
+    const [lat, lon, uncertainty] = args.default.split(',').map(Number);
+    default_fix = { lat, lon, uncertainty: uncertainty || 1000 };
+}
+const delay = Number(args.delay);
+
+/**
+ * Same compact response the Lambda sends
+ */
+function device_response(id, fix) {
+    if (!fix) {
+        return { id, err: 1 };
+    }
+    return {
+        id,
+        lat: Math.round(fix.lat * 1e6),
+        lon: Math.round(fix.lon * 1e6),
+        acc: Math.round(fix.uncertainty),
+    };
+}
+
+const client = mqtt.connect(args.broker);
+
+client.on('connect', () => {
+    console.log(`Connected to ${args.broker}, ${Object.keys(cells).length} known cells`);
+    client.subscribe('location/+/req');
+});
+
+client.on('message', (topic, payload) => {
+    const device = topic.split('/')[1];
+    let req;
+    try {
+        req = JSON.parse(payload.toString());
+    } catch (err) {
+        console.log(`Bad request from ${device}: ${err}`);
+        return;
+    }
+
+    const key = `${req.mcc}/${req.mnc}/${req.eci}`;
+    const fix = cells[key] || default_fix;
+    const response = device_response(req.id, fix);
+
+    setTimeout(() => {
+        client.publish(`location/${device}/res`, JSON.stringify(response));
+        console.log(`${device} ${key} -> ${JSON.stringify(response)}`);
+    }, delay);
+});
@@ -0,0 +1,440 @@
+// Fleet load generator for the device to Lambda pipeline.
+//
+// Simulates N trackers speaking the firmware's wire formats (shadow
+// updates and nrfcloud/agps/get requests, as built in src/json_common.c)
+// against a local MQTT broker. An in-process rule engine feeds the A-GNSS
+// requests to the real lambda/agnss.mjs handler, whose SSM, nRF Cloud and
+// IoT Data Plane calls go to local stubs (lib/stubs.mjs).
+//
+// Needs `npm install` in both tools/ and lambda/ (AWS_ENDPOINT_URL
+// support needs AWS SDK v3.490 or later).
+//
+//   node fleet_load.mjs --devices 2000 --ramp 0 --duration 120
+//   node fleet_load.mjs --devices 2000 --ramp 60 --outage 90 --duration 180
+//
+// Options:
+//   --broker URL           Use an existing broker instead of the embedded one
+//   --port N               Port for the embedded broker (1883)
+//   --devices N            Simulated trackers (100)
+//   --ramp S               Spread connections over S seconds, 0 = storm (0)
+//   --duration S           Run time after the first connection (60)
+//   --outage S             Drop every device S seconds after the first
+//                          connection, then reconnect them all at once (off)
+//   --outage-length S      Time the devices stay offline (10)
+//   --interval S           Mean time between messages per device (30)
+//   --mix shadow=W,agnss=W Relative weights of the periodic messages (1,1)
+//   --agnss-blob PATH|N    Recorded A-GNSS response, or N random bytes (3800)
+//   --cloud-latency MS     Added to every nRF Cloud response (50)
+//   --lambda-concurrency N Concurrent handler invocations (1000)
+//
+// --ramp 0 is a first boot storm: no stored sessions, every device subscribes.
+// --outage is the storm after a network outage: devices reconnect with
+// clean: false like the firmware, so the broker resumes their sessions.
+import * as net from 'node:net';
+import { createRequire } from 'node:module';
+import { parseArgs } from 'node:util';
+import mqtt from 'mqtt';
+
+import { start_stubs, redirect_to_stubs } from './lib/stubs.mjs';
+import { Samples, print_summaries } from './lib/metrics.mjs';
+
+const require = createRequire(import.meta.url);
+
+const AGNSS_REQUEST_TOPIC = 'nrfcloud/agps/get';
+const AGNSS_RESPONSE_TOPIC = 'nrfcloud/agps';
+
+const { values: args } = parseArgs({
+    options: {
+        broker: { type: 'string' },
+        port: { type: 'string', default: '1883' },
+        devices: { type: 'string', default: '100' },
+        ramp: { type: 'string', default: '0' },
+        duration: { type: 'string', default: '60' },
+        outage: { type: 'string' },
+        'outage-length': { type: 'string', default: '10' },
+        interval: { type: 'string', default: '30' },
+        mix: { type: 'string', default: 'shadow=1,agnss=1' },
+        'agnss-blob': { type: 'string', default: '3800' },
+        'cloud-latency': { type: 'string', default: '50' },
+        'lambda-concurrency': { type: 'string', default: '1000' },
+    },
+});
+
+const device_count = Number(args.devices);
+const ramp_ms = Number(args.ramp) * 1000;
+const duration_ms = Number(args.duration) * 1000;
+const interval_ms = Number(args.interval) * 1000;
+const outage_ms = args.outage === undefined ? null : Number(args.outage) * 1000;
+const outage_length_ms = Number(args['outage-length']) * 1000;
+const lambda_concurrency = Number(args['lambda-concurrency']);
+const agnss_blob = /^\d+$/.test(args['agnss-blob']) ? Number(args['agnss-blob']) : args['agnss-blob'];
+
+const mix = Object.fromEntries(args.mix.split(',').map((kv) => {
+    const [ k, v ] = kv.split('=');
+    return [ k, Number(v) ];
+}));
+const mix_total = (mix.shadow || 0) + (mix.agnss || 0);
+
+const metrics = {
+    connect: new Samples(),
+    reconnect: new Samples(),
+    shadow_puback: new Samples(),
+    agnss_to_last_publish: new Samples(),
+    agnss_broker_delivery: new Samples(),
+    lambda_queue_wait: new Samples(),
+    lambda_duration: new Samples(),
+};
+const counters = {
+    connect_errors: 0,
+    sessions_resumed: 0,
+    sessions_new: 0,
+    dropped_in_outage: 0,
+    publish_errors: 0,
+    lambda_errors: 0,
+    shadow_sent: 0,
+    agnss_sent: 0,
+    agnss_timeouts: 0,
+    bytes_to_devices: 0,
+    bytes_from_lambda: 0,
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Broker
+
+let broker_url = args.broker;
+let broker_server = null;
+if (!broker_url) {
+    const aedes = require('aedes')();
+    broker_server = net.createServer(aedes.handle);
+    await new Promise((resolve) => broker_server.listen(Number(args.port), resolve));
+    broker_url = `mqtt://127.0.0.1:${args.port}`;
+    console.log(`Embedded broker on ${broker_url}`);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Stubs, the rule engine and the Lambda
+
+const rules = mqtt.connect(broker_url, { clientId: 'rules-engine' });
+await new Promise((resolve) => rules.on('connect', resolve));
+
+// Chunks forwarded to the broker and not yet looped back, oldest first.
+// One connection keeps QoS 0 order, so the oldest is the one that arrives.
+const forwarded = [];
+
+const stubs = await start_stubs({
+    agnss_blob,
+    cloud_latency_ms: Number(args['cloud-latency']),
+}, (topic, payload) => {
+    counters.bytes_from_lambda += payload.length;
+    forwarded.push(performance.now());
+    rules.publish(topic, payload);
+});
+redirect_to_stubs(stubs.port);
+
+const { handler } = await import('../lambda/agnss.mjs');
+
+// Invocations beyond the concurrency limit wait, like Lambda throttling
+// with retries would.
+let running = 0;
+const waiting = [];
+
+function invoke(event) {
+    const queued = performance.now();
+    const dev = devices_by_eci.get(event.eci);
+    const run = () => {
+        running++;
+        const started = performance.now();
+        metrics.lambda_queue_wait.add(started - queued);
+        handler(event, {}, (err) => {
+            const done = performance.now();
+            if (err) {
+                counters.lambda_errors++;
+            }
+            metrics.lambda_duration.add(done - started);
+            // The handler only calls back once all its chunks are published
+            if (dev && dev.agnss_start !== null) {
+                metrics.agnss_to_last_publish.add(done - dev.agnss_start);
+                dev.agnss_start = null;
+            }
+            running--;
+            if (waiting.length) {
+                waiting.shift()();
+            }
+        });
+    };
+    if (running < lambda_concurrency) {
+        run();
+    } else {
+        waiting.push(run);
+    }
+}
+
+rules.subscribe([ AGNSS_REQUEST_TOPIC, AGNSS_RESPONSE_TOPIC ]);
+rules.on('message', (topic, payload) => {
+    if (topic === AGNSS_RESPONSE_TOPIC) {
+        // Broker delivery of a chunk, publish to the first subscriber
+        if (forwarded.length) {
+            metrics.agnss_broker_delivery.add(performance.now() - forwarded.shift());
+        }
+        return;
+    }
+    try {
+        invoke(JSON.parse(payload.toString()));
+    } catch (err) {
+        counters.lambda_errors++;
+    }
+});
+
+//////////////////////////////////////////////////////////////////////////////
+// Devices
+
+const run_start = performance.now();
+const clients = [];
+// Requests carry the device's serving cell, which is unique per device
+const devices_by_eci = new Map();
+let stopping = false;
+
+/**
+ * Exponential inter-arrival time, so the fleet sends as a Poisson process
+ */
+const next_delay = () => -Math.log(1 - Math.random()) * interval_ms;
+
+// Threads health_mod_sample() reports, with the stack sizes of this build
+const threads = [
+    [ 'main', 8192 ],
+    [ 'sysworkq', 4096 ],
+    [ 'connection_poll_thread', 3072 ],
+    [ 'location_api_workq', 4096 ],
+    [ 'connection_wq', 3072 ],
+    [ 'fota_wq', 2048 ],
+    [ 'idle', 320 ],
+];
+
+function shadow_payload(dev) {
+    // Same layout as json_shadow_construct()
+    return JSON.stringify({
+        state: {
+            reported: {
+                uptime: Math.round(performance.now() - dev.boot),
+                mcc: 310, mnc: 410, tac: 1000 + (dev.index % 50), eci: 80000000 + dev.index,
+                config: { fix_interval: 30, gnss_timeout: 100, cell_timeout: 40, ping_period: 10, agnss_mask: 8191 },
+                conn: {
+                    count: dev.conn_count, resumed: dev.resumed,
+                    connect_ms: Math.round(dev.connect_ms), outage_ms: Math.round(dev.outage_ms),
+                },
+                health: {
+                    heap_free: 20000, heap_max_used: 18000, heap_frag: 5, wq_us: 120, wq_max_us: 900, alerts: 0,
+                    threads: threads.map(([ name, size ]) => ({ name, size, unused: Math.round(size * 0.4) })),
+                },
+                fota: { state: 'idle', progress: 0, err: 0, version: '' },
+            },
+        },
+    });
+}
+
+function agnss_payload(dev) {
+    // Same fields as json_agnss_req_construct()
+    return JSON.stringify({
+        mcc: 310, mnc: 410, tac: 1000 + (dev.index % 50), eci: 80000000 + dev.index,
+        rsrp: -95, filtered: true, mask: 8191, chunk_size: 4200,
+    });
+}
+
+function send_shadow(dev) {
+    if (!dev.online) {
+        return;
+    }
+    const sent = performance.now();
+    counters.shadow_sent++;
+    dev.client.publish(`$aws/things/${dev.id}/shadow/update`, shadow_payload(dev), { qos: 1 }, (err) => {
+        if (err) {
+            counters.publish_errors++;
+            return;
+        }
+        metrics.shadow_puback.add(performance.now() - sent);
+    });
+}
+
+function send_agnss(dev) {
+    if (!dev.online || dev.agnss_start !== null) {
+        // Still waiting for the previous answer, the firmware would too
+        return;
+    }
+    counters.agnss_sent++;
+    dev.agnss_start = performance.now();
+    dev.client.publish(AGNSS_REQUEST_TOPIC, agnss_payload(dev), { qos: 0 });
+}
+
+function schedule(dev) {
+    if (stopping) {
+        return;
+    }
+    dev.timer = setTimeout(() => {
+        if (Math.random() * mix_total < (mix.shadow || 0)) {
+            send_shadow(dev);
+        } else {
+            send_agnss(dev);
+        }
+        schedule(dev);
+    }, next_delay());
+}
+
+function connect_device(dev) {
+    const attempt = performance.now();
+    const reconnect = dev.conn_count > 0;
+
+    dev.client = mqtt.connect(broker_url, {
+        clientId: dev.id,
+        clean: false,
+        keepalive: 1200,
+        reconnectPeriod: 0,
+        connectTimeout: 60000,
+    });
+
+    dev.client.on('error', () => counters.connect_errors++);
+    dev.client.on('connect', (connack) => {
+        const ready = () => {
+            dev.online = true;
+            // Firmware on every connect: shadow get, then the report
+            dev.client.publish(`$aws/things/${dev.id}/shadow/get`, '', { qos: 0 });
+            send_shadow(dev);
+            if (!reconnect) {
+                // A-GNSS is only requested at boot
+                send_agnss(dev);
+            }
+            schedule(dev);
+        };
+
+        dev.connect_ms = performance.now() - attempt;
+        dev.conn_count++;
+        if (reconnect) {
+            metrics.reconnect.add(dev.connect_ms);
+            dev.outage_ms = performance.now() - dev.dropped_at;
+            if (connack.sessionPresent) {
+                counters.sessions_resumed++;
+                dev.resumed++;
+            } else {
+                counters.sessions_new++;
+            }
+        } else {
+            metrics.connect.add(dev.connect_ms);
+        }
+
+        // aws_iot skips subscribing when the broker resumed the session
+        if (connack.sessionPresent) {
+            ready();
+        } else {
+            dev.client.subscribe(AGNSS_RESPONSE_TOPIC, { qos: 0 }, ready);
+        }
+    });
+    dev.client.on('message', (topic, payload) => {
+        // The response topic is shared and chunks carry no requester, so
+        // a device cannot tell its own answer apart. Latency is measured
+        // in the rule engine instead, this only counts the fan-out.
+        counters.bytes_to_devices += payload.length;
+    });
+}
+
+function start_device(index) {
+    const dev = {
+        index,
+        id: `sim-${String(index).padStart(5, '0')}`,
+        boot: performance.now(),
+        online: false,
+        conn_count: 0,
+        resumed: 0,
+        connect_ms: 0,
+        outage_ms: 0,
+        dropped_at: 0,
+        agnss_start: null,
+        client: null,
+        timer: null,
+    };
+
+    clients.push(dev);
+    devices_by_eci.set(80000000 + index, dev);
+    connect_device(dev);
+}
+
+/**
+ * Cut every device off without a DISCONNECT, like a cell outage would,
+ * and bring them all back at the same moment
+ */
+async function outage() {
+    for (const dev of clients) {
+        clearTimeout(dev.timer);
+        if (dev.agnss_start !== null) {
+            // The answer is lost with the connection
+            counters.dropped_in_outage++;
+            dev.agnss_start = null;
+        }
+        dev.online = false;
+        dev.dropped_at = performance.now();
+        dev.client.removeAllListeners();
+        dev.client.on('error', () => {});
+        dev.client.stream.destroy();
+    }
+    console.log(`Outage: ${clients.length} devices dropped for ${outage_length_ms / 1000} s`);
+
+    await new Promise((resolve) => setTimeout(resolve, outage_length_ms));
+    if (stopping) {
+        return;
+    }
+
+    console.log('Outage over, reconnecting every device');
+    for (const dev of clients) {
+        connect_device(dev);
+    }
+}
+
+for (let i = 0; i < device_count; i++) {
+    if (ramp_ms === 0) {
+        start_device(i);
+    } else {
+        setTimeout(() => start_device(i), (i * ramp_ms) / device_count);
+    }
+}
+
+if (outage_ms !== null) {
+    setTimeout(outage, outage_ms);
+}
+
+await new Promise((resolve) => setTimeout(resolve, ramp_ms + duration_ms));
+
+//////////////////////////////////////////////////////////////////////////////
+// Report
+
+stopping = true;
+const elapsed_s = (performance.now() - run_start) / 1000;
+for (const dev of clients) {
+    clearTimeout(dev.timer);
+    if (dev.agnss_start !== null) {
+        counters.agnss_timeouts++;
+    }
+    dev.client.end(true);
+}
+rules.end(true);
+await stubs.close();
+if (broker_server) {
+    broker_server.close();
+}
+
+console.log(`\n${device_count} devices, ramp ${ramp_ms / 1000} s, ran ${elapsed_s.toFixed(1)} s` +
+            (outage_ms === null ? '' : `, ${outage_length_ms / 1000} s outage at ${outage_ms / 1000} s`));
+print_summaries('Latency', metrics);
+console.log('  A-GNSS end to end is agnss_to_last_publish plus agnss_broker_delivery');
+
+console.log('\nThroughput');
+console.log(`  device publishes/s      ${((counters.shadow_sent + counters.agnss_sent) / elapsed_s).toFixed(1)}`);
+console.log(`  lambda invocations/s    ${(metrics.lambda_duration.values.length / elapsed_s).toFixed(1)}`);
+console.log(`  nRF Cloud requests/s    ${(stubs.stats.agnss / elapsed_s).toFixed(1)}`);
+console.log(`  bytes to devices/s      ${(counters.bytes_to_devices / elapsed_s).toFixed(0)}`);
+console.log(`  A-GNSS fan-out          ${(counters.bytes_to_devices / Math.max(counters.bytes_from_lambda, 1)).toFixed(1)}x`);
+
+console.log('\nCounters');
+for (const [ name, value ] of Object.entries(counters)) {
+    console.log(`  ${name.padEnd(22)} ${value}`);
+}
+console.log(`  lambda_still_queued    ${waiting.length}`);
+
+process.exit(0);
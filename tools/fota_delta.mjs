@@ -0,0 +1,163 @@
+// Build and check delta patches for the device FOTA (src/fota_patch.h
+// documents the format).
+//
+//   node fota_delta.mjs diff old.bin new.bin out.patch
+//   node fota_delta.mjs apply old.bin in.patch out.bin
+//
+// old.bin must be byte for byte the signed image running in the primary
+// slot, new.bin the signed image to install.
+import { createHash } from 'node:crypto';
+import { readFileSync, writeFileSync } from 'node:fs';
+import { fileURLToPath } from 'node:url';
+
+const MAGIC = 0x31545044;
+const OP_END = 0x00;
+const OP_COPY = 0x01;
+const OP_INSERT = 0x02;
+
+// Seed length for the match index and the shortest copy worth emitting
+// (a COPY costs 9 bytes, an INSERT 5 bytes plus the data).
+const BLOCK = 16;
+const MIN_COPY = 24;
+const STEP = 2;
+const MAX_CANDIDATES = 16;
+
+const sha256 = (buf) => createHash('sha256').update(buf).digest();
+
+function u32(val) {
+    const b = Buffer.alloc(4);
+    b.writeUInt32LE(val);
+    return b;
+}
+
+/**
+ * Greedy copy/insert diff against an index of the old image
+ */
+export function diff(old_img, new_img) {
+    const index = new Map();
+    for (let i = 0; i + BLOCK <= old_img.length; i += STEP) {
+        const key = old_img.subarray(i, i + BLOCK).toString('latin1');
+        const list = index.get(key);
+        if (!list) {
+            index.set(key, [ i ]);
+        } else if (list.length < MAX_CANDIDATES) {
+            list.push(i);
+        }
+    }
+
+    const out = [
+        u32(MAGIC), u32(old_img.length), u32(new_img.length),
+        sha256(old_img), sha256(new_img),
+    ];
+    let copied = 0;
+    let lit_start = 0;
+    let p = 0;
+
+    const flush_literal = (end) => {
+        if (end > lit_start) {
+            out.push(Buffer.from([ OP_INSERT ]), u32(end - lit_start),
+                     new_img.subarray(lit_start, end));
+        }
+    };
+
+    while (p + BLOCK <= new_img.length) {
+        const candidates = index.get(new_img.subarray(p, p + BLOCK).toString('latin1')) || [];
+        let best_off = 0;
+        let best_len = 0;
+        for (const off of candidates) {
+            let len = 0;
+            while (off + len < old_img.length && p + len < new_img.length &&
+                   old_img[off + len] === new_img[p + len]) {
+                len++;
+            }
+            if (len > best_len) {
+                best_off = off;
+                best_len = len;
+            }
+        }
+
+        if (best_len < MIN_COPY) {
+            p++;
+            continue;
+        }
+
+        flush_literal(p);
+        out.push(Buffer.from([ OP_COPY ]), u32(best_off), u32(best_len));
+        copied += best_len;
+        p += best_len;
+        lit_start = p;
+    }
+
+    flush_literal(new_img.length);
+    out.push(Buffer.from([ OP_END ]));
+
+    return { patch: Buffer.concat(out), copied };
+}
+
+/**
+ * Reference implementation of what the device does, for checking patches
+ */
+export function apply(old_img, patch) {
+    if (patch.readUInt32LE(0) !== MAGIC) {
+        throw new Error('bad magic');
+    }
+    const source_size = patch.readUInt32LE(4);
+    const target_size = patch.readUInt32LE(8);
+    if (source_size !== old_img.length || !sha256(old_img).equals(patch.subarray(12, 44))) {
+        throw new Error('patch does not match the old image');
+    }
+
+    const out = Buffer.alloc(target_size);
+    let written = 0;
+    let p = 76;
+    for (;;) {
+        const op = patch[p++];
+        if (op === OP_END) {
+            break;
+        } else if (op === OP_COPY) {
+            const off = patch.readUInt32LE(p);
+            const len = patch.readUInt32LE(p + 4);
+            p += 8;
+            written += old_img.copy(out, written, off, off + len);
+        } else if (op === OP_INSERT) {
+            const len = patch.readUInt32LE(p);
+            p += 4;
+            written += patch.copy(out, written, p, p + len);
+            p += len;
+        } else {
+            throw new Error(`bad op ${op} at ${p - 1}`);
+        }
+    }
+
+    if (p !== patch.length || written !== target_size ||
+        !sha256(out).equals(patch.subarray(44, 76))) {
+        throw new Error('patched image does not verify');
+    }
+    return out;
+}
+
+function main() {
+    const [ cmd, a, b, c ] = process.argv.slice(2);
+    if (cmd === 'diff' && c) {
+        const old_img = readFileSync(a);
+        const new_img = readFileSync(b);
+        const { patch, copied } = diff(old_img, new_img);
+        apply(old_img, patch);
+        writeFileSync(c, patch);
+        console.log(`${c}: ${patch.length} bytes for a ${new_img.length} byte image ` +
+                    `(${(100 * patch.length / new_img.length).toFixed(1)}%, ` +
+                    `${copied} bytes reused)`);
+    } else if (cmd === 'apply' && c) {
+        writeFileSync(c, apply(readFileSync(a), readFileSync(b)));
+        console.log(`${c}: verified`);
+    } else {
+        console.log('usage: fota_delta.mjs diff old.bin new.bin out.patch');
+        console.log('       fota_delta.mjs apply old.bin in.patch out.bin');
+        process.exit(1);
+    }
+}
+
+// Also imported for diff() and apply(), see tests/fota_patch
+if (process.argv[1] === fileURLToPath(import.meta.url)) {
+    main();
+}
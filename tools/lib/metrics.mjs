@@ -0,0 +1,40 @@
+// Latency sample collection and percentile summaries for the host tools.
+
+export class Samples {
+    constructor() {
+        this.values = [];
+    }
+
+    add(value) {
+        this.values.push(value);
+    }
+
+    summary() {
+        const sorted = [ ...this.values ].sort((a, b) => a - b);
+        const pick = (p) => sorted.length
+            ? sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))]
+            : NaN;
+        return {
+            count: sorted.length,
+            p50: pick(0.50),
+            p90: pick(0.90),
+            p99: pick(0.99),
+            max: sorted.length ? sorted[sorted.length - 1] : NaN,
+        };
+    }
+}
+
+/**
+ * Print a table of summaries, one row per named Samples
+ */
+export function print_summaries(title, rows, unit = 'ms') {
+    console.log(`\n${title}`);
+    console.log(`  ${'metric'.padEnd(24)}${'count'.padStart(8)}` +
+                ['p50', 'p90', 'p99', 'max'].map((h) => `${h} ${unit}`.padStart(12)).join(''));
+    for (const [ name, samples ] of Object.entries(rows)) {
+        const s = samples.summary();
+        const fmt = (v) => (Number.isNaN(v) ? '-' : v.toFixed(1)).padStart(12);
+        console.log(`  ${name.padEnd(24)}${String(s.count).padStart(8)}` +
+                    `${fmt(s.p50)}${fmt(s.p90)}${fmt(s.p99)}${fmt(s.max)}`);
+    }
+}
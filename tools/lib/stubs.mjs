@@ -0,0 +1,115 @@
+// Local stand-ins for the services the Lambdas talk to: SSM (service key),
+// IoT Data Plane (MQTT publish) and the nRF Cloud A-GNSS endpoint.
+import * as http from 'node:http';
+import { createRequire, syncBuiltinESMExports } from 'node:module';
+import { randomBytes } from 'node:crypto';
+import { readFileSync } from 'node:fs';
+
+const require = createRequire(import.meta.url);
+
+const NRF_CLOUD_HOST = 'api.nrfcloud.com';
+
+/**
+ * Parse "bytes=start-end", clamped to size
+ */
+function parse_range(header, size) {
+    const matches = header && header.match(/^bytes=(\d+)-(\d*)$/);
+    if (!matches) {
+        return null;
+    }
+    const start = Number(matches[1]);
+    const end = matches[2] === '' ? size - 1 : Math.min(Number(matches[2]), size - 1);
+    return start <= end ? { start, end } : null;
+}
+
+/**
+ * Start the stub server. on_publish(topic, payload) is called for every
+ * IoT Data Plane publish.
+ *
+ * options.agnss_blob: path to a recorded A-GNSS response, or a byte count
+ *                     for random data
+ * options.cloud_latency_ms: delay added to every nRF Cloud response
+ */
+export async function start_stubs(options, on_publish) {
+    const blob = typeof options.agnss_blob === 'string'
+        ? readFileSync(options.agnss_blob)
+        : randomBytes(options.agnss_blob || 3800);
+    const latency = options.cloud_latency_ms || 0;
+    const stats = { ssm: 0, publish: 0, agnss: 0, agnss_bytes: 0 };
+
+    const server = http.createServer((req, res) => {
+        const body = [];
+        req.on('data', (chunk) => body.push(chunk));
+        req.on('end', () => {
+            const payload = Buffer.concat(body);
+            const url = new URL(req.url, 'http://localhost');
+
+            if (req.headers['x-amz-target'] === 'AmazonSSM.GetParameter') {
+                stats.ssm++;
+                const name = JSON.parse(payload.toString()).Name;
+                res.writeHead(200, { 'Content-Type': 'application/x-amz-json-1.1' });
+                res.end(JSON.stringify({
+                    Parameter: { Name: name, Type: 'SecureString', Value: 'stub-service-key', Version: 1 },
+                }));
+            } else if (url.pathname.startsWith('/topics/')) {
+                stats.publish++;
+                on_publish(decodeURIComponent(url.pathname.slice('/topics/'.length)), payload);
+                res.writeHead(200, { 'Content-Type': 'application/json' });
+                res.end('{}');
+            } else if (url.pathname === '/v1/location/agnss') {
+                stats.agnss++;
+                const range = parse_range(req.headers.range, blob.length);
+                setTimeout(() => {
+                    if (!range) {
+                        stats.agnss_bytes += blob.length;
+                        res.writeHead(200, { 'Content-Length': blob.length });
+                        res.end(blob);
+                        return;
+                    }
+                    const part = blob.subarray(range.start, range.end + 1);
+                    stats.agnss_bytes += part.length;
+                    res.writeHead(206, {
+                        'Content-Length': part.length,
+                        'Content-Range': `bytes ${range.start}-${range.end}/${blob.length}`,
+                    });
+                    res.end(part);
+                }, latency);
+            } else {
+                res.writeHead(404);
+                res.end();
+            }
+        });
+    });
+
+    await new Promise((resolve) => server.listen(0, '127.0.0.1', resolve));
+    const port = server.address().port;
+
+    return {
+        port,
+        stats,
+        blob,
+        close: () => new Promise((resolve) => server.close(resolve)),
+    };
+}
+
+/**
+ * Point the AWS SDK and the Lambdas' https calls to nRF Cloud at the stubs.
+ * Must run before a Lambda module is imported.
+ */
+export function redirect_to_stubs(port) {
+    process.env.AWS_ENDPOINT_URL = `http://127.0.0.1:${port}`;
+    process.env.AWS_REGION = process.env.AWS_REGION || 'us-east-1';
+    process.env.AWS_ACCESS_KEY_ID = process.env.AWS_ACCESS_KEY_ID || 'stub';
+    process.env.AWS_SECRET_ACCESS_KEY = process.env.AWS_SECRET_ACCESS_KEY || 'stub';
+
+    const https = require('node:https');
+    const https_request = https.request;
+    https.request = (options, callback) => {
+        if (typeof options === 'object' && options.hostname === NRF_CLOUD_HOST) {
+            return http.request({ ...options, hostname: '127.0.0.1', port, protocol: 'http:' }, callback);
+        }
+        return https_request(options, callback);
+    };
+    // Lambdas use `import * as https`, refresh the ESM view of the module
+    syncBuiltinESMExports();
+}